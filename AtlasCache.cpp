@@ -0,0 +1,68 @@
+#include "AtlasCache.h"
+
+#include <iostream>
+#include <random>
+
+AtlasCache::AtlasCache(std::filesystem::path directory) : directory(directory)
+{
+}
+
+bool AtlasCache::restore(const std::string &key)
+{
+    std::error_code error;
+    std::filesystem::path entry = directory / key;
+    if (!std::filesystem::is_directory(entry, error))
+    {
+        return false;
+    }
+
+    for (auto &file : std::filesystem::directory_iterator(entry, error))
+    {
+        std::filesystem::path target = file.path().filename();
+        std::filesystem::remove(target, error);
+        std::filesystem::create_hard_link(file.path(), target, error);
+        if (error)
+        {
+            std::filesystem::copy_file(file.path(), target, std::filesystem::copy_options::overwrite_existing, error);
+        }
+        if (error)
+        {
+            std::cout << "AtlasCache::restore() -> Failed to restore " << target << ": " << error.message() << std::endl;
+            return false;
+        }
+        std::cout << "AtlasCache::restore() -> restored " << target << std::endl;
+    }
+    return true;
+}
+
+void AtlasCache::store(const std::string &key, const std::vector<std::string> &files)
+{
+    std::error_code error;
+    std::filesystem::path entry = directory / key;
+    if (std::filesystem::is_directory(entry, error))
+    {
+        return;
+    }
+
+    // fill a private directory first and rename it into place, so concurrent runs never see a
+    // partially written entry
+    std::filesystem::path staging = directory / (key + ".tmp" + std::to_string(std::random_device()()));
+    std::filesystem::create_directories(staging, error);
+    for (auto &file : files)
+    {
+        if (!error)
+        {
+            std::filesystem::copy_file(file, staging / std::filesystem::path(file).filename(), error);
+        }
+    }
+    if (!error)
+    {
+        std::filesystem::rename(staging, entry, error);
+    }
+    if (error)
+    {
+        std::filesystem::remove_all(staging, error);
+        return;
+    }
+    std::cout << "AtlasCache::store() -> Cached " << files.size() << " files as " << key << std::endl;
+}
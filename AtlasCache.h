@@ -0,0 +1,24 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Content addressed store of generated atlas files. Each key maps to a directory holding every
+// file one FontAtlas wrote, see FontAtlas::cacheKey for what goes into a key.
+class AtlasCache {
+    public:
+
+    AtlasCache(std::filesystem::path directory);
+
+    // Hard links (or copies, where linking fails) the files stored under key into the working
+    // directory. Returns false if there is no entry for key.
+    bool restore(const std::string &key);
+
+    // Copies files into a new entry for key. An existing entry is left untouched.
+    void store(const std::string &key, const std::vector<std::string> &files);
+
+    private:
+
+    std::filesystem::path directory;
+};
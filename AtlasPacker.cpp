@@ -0,0 +1,347 @@
+#include "AtlasPacker.h"
+
+#include <algorithm>
+#include <climits>
+
+std::unique_ptr<AtlasPacker> AtlasPacker::create(const std::string &name)
+{
+    if (name == "shelf")
+    {
+        return std::make_unique<ShelfPacker>();
+    }
+    if (name == "maxrects")
+    {
+        return std::make_unique<MaxRectsPacker>();
+    }
+    if (name == "skyline")
+    {
+        return std::make_unique<SkylinePacker>();
+    }
+    return nullptr;
+}
+
+static void placeEntry(FontAtlasEntry *e, int x, int y, int page)
+{
+    e->page = page;
+    e->sx = x;
+    e->sy = y;
+    e->ex = x + e->w;
+    e->ey = y + e->h;
+}
+
+int ShelfPacker::pack(std::vector<FontAtlasEntry *> &entries, int atlasWidth, int maxHeight)
+{
+    int atlasCursorX = 0;
+    int atlasCursorY = 0;
+    int atlasRowTallestChar = 0;
+    int atlasHeight = 0;
+    int page = 0;
+
+    for (auto i : entries)
+    {
+        if ((atlasCursorX + i->w) > atlasWidth)
+        {
+            atlasCursorX = 0;
+            atlasCursorY += atlasRowTallestChar;
+            atlasRowTallestChar = 0;
+        }
+
+        if (atlasCursorY + i->h > maxHeight && atlasCursorY + atlasCursorX > 0)
+        {
+            // page is full, the current row carries on at the top of the next one
+            page++;
+            atlasCursorX = 0;
+            atlasCursorY = 0;
+            atlasRowTallestChar = 0;
+        }
+
+        if (i->h > atlasRowTallestChar)
+        {
+            atlasRowTallestChar = i->h;
+            atlasHeight = std::max(atlasHeight, atlasCursorY + atlasRowTallestChar);
+        }
+
+        placeEntry(i, atlasCursorX, atlasCursorY, page);
+        atlasCursorX += i->w;
+    }
+    return atlasHeight;
+}
+
+int MaxRectsPacker::pack(std::vector<FontAtlasEntry *> &entries, int atlasWidth, int maxHeight)
+{
+    if (maxHeight != INT_MAX)
+    {
+        // fixed page size, start a new page whenever a glyph does not fit
+        packInto(entries, atlasWidth, maxHeight, true);
+    }
+    else
+    {
+        long long area = 0;
+        int tallest = 1;
+        for (auto e : entries)
+        {
+            area += (long long)e->w * e->h;
+            tallest = std::max(tallest, e->h);
+        }
+
+        int atlasHeight = std::max(tallest, (int)(area / std::max(1, atlasWidth)));
+        while (!packInto(entries, atlasWidth, atlasHeight, false))
+        {
+            atlasHeight += std::max(1, atlasHeight / 8);
+        }
+    }
+
+    int usedHeight = 0;
+    for (auto e : entries)
+    {
+        usedHeight = std::max(usedHeight, e->ey);
+    }
+    return usedHeight;
+}
+
+bool MaxRectsPacker::packInto(std::vector<FontAtlasEntry *> &entries, int atlasWidth, int atlasHeight, bool spillPages)
+{
+    int page = 0;
+    freeRects.clear();
+    freeRects.push_back({0, 0, atlasWidth, atlasHeight});
+
+    for (auto e : entries)
+    {
+        if (e->w == 0 || e->h == 0)
+        {
+            placeEntry(e, 0, 0, 0);
+            continue;
+        }
+
+        Rect best;
+        if (!findPosition(e->w, e->h, best))
+        {
+            if (!spillPages)
+            {
+                return false;
+            }
+            page++;
+            freeRects.clear();
+            freeRects.push_back({0, 0, atlasWidth, atlasHeight});
+            if (!findPosition(e->w, e->h, best))
+            {
+                return false;
+            }
+        }
+
+        placeEntry(e, best.x, best.y, page);
+        splitFreeRects({e->sx, e->sy, e->w, e->h});
+        pruneFreeRects();
+    }
+    return true;
+}
+
+bool MaxRectsPacker::findPosition(int w, int h, Rect &position)
+{
+    // best short side fit, ties broken on the long side
+    bool found = false;
+    int bestShortSide = INT_MAX;
+    int bestLongSide = INT_MAX;
+    for (auto &r : freeRects)
+    {
+        if (r.w < w || r.h < h)
+        {
+            continue;
+        }
+        int leftoverX = r.w - w;
+        int leftoverY = r.h - h;
+        int shortSide = std::min(leftoverX, leftoverY);
+        int longSide = std::max(leftoverX, leftoverY);
+        if (shortSide < bestShortSide || (shortSide == bestShortSide && longSide < bestLongSide))
+        {
+            position = r;
+            found = true;
+            bestShortSide = shortSide;
+            bestLongSide = longSide;
+        }
+    }
+    return found;
+}
+
+void MaxRectsPacker::splitFreeRects(const Rect &used)
+{
+    newFreeRects.clear();
+    for (size_t i = 0; i < freeRects.size();)
+    {
+        Rect r = freeRects[i];
+        if (used.x >= r.x + r.w || used.x + used.w <= r.x || used.y >= r.y + r.h || used.y + used.h <= r.y)
+        {
+            ++i;
+            continue;
+        }
+
+        // keep the parts of r on each side of the used rectangle
+        if (used.x > r.x)
+        {
+            newFreeRects.push_back({r.x, r.y, used.x - r.x, r.h});
+        }
+        if (used.x + used.w < r.x + r.w)
+        {
+            newFreeRects.push_back({used.x + used.w, r.y, r.x + r.w - (used.x + used.w), r.h});
+        }
+        if (used.y > r.y)
+        {
+            newFreeRects.push_back({r.x, r.y, r.w, used.y - r.y});
+        }
+        if (used.y + used.h < r.y + r.h)
+        {
+            newFreeRects.push_back({r.x, used.y + used.h, r.w, r.y + r.h - (used.y + used.h)});
+        }
+
+        freeRects[i] = freeRects.back();
+        freeRects.pop_back();
+    }
+}
+
+static bool containedIn(const MaxRectsPacker::Rect &a, const MaxRectsPacker::Rect &b)
+{
+    return a.x >= b.x && a.y >= b.y && a.x + a.w <= b.x + b.w && a.y + a.h <= b.y + b.h;
+}
+
+void MaxRectsPacker::pruneFreeRects()
+{
+    // only the rectangles created by the last split can contain or be contained by others, the
+    // existing free list was already maximal
+    for (size_t i = 0; i < newFreeRects.size();)
+    {
+        bool redundant = false;
+        for (size_t j = 0; j < newFreeRects.size(); ++j)
+        {
+            if (i != j && containedIn(newFreeRects[i], newFreeRects[j]) &&
+                (!containedIn(newFreeRects[j], newFreeRects[i]) || i > j))
+            {
+                redundant = true;
+                break;
+            }
+        }
+        for (size_t j = 0; !redundant && j < freeRects.size(); ++j)
+        {
+            redundant = containedIn(newFreeRects[i], freeRects[j]);
+        }
+
+        if (redundant)
+        {
+            newFreeRects[i] = newFreeRects.back();
+            newFreeRects.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    freeRects.insert(freeRects.end(), newFreeRects.begin(), newFreeRects.end());
+}
+
+int SkylinePacker::pack(std::vector<FontAtlasEntry *> &entries, int atlasWidth, int maxHeight)
+{
+    skyline.clear();
+    skyline.push_back({0, 0, atlasWidth});
+
+    int atlasHeight = 0;
+    int page = 0;
+    for (auto e : entries)
+    {
+        if (e->w == 0 || e->h == 0)
+        {
+            placeEntry(e, 0, 0, 0);
+            continue;
+        }
+
+        size_t bestSegment = 0;
+        int bestTop = INT_MAX;
+        int bestWidth = INT_MAX;
+        int bestY = 0;
+        for (size_t i = 0; i < skyline.size(); ++i)
+        {
+            int y = fitAt(i, e->w, atlasWidth);
+            if (y < 0)
+            {
+                continue;
+            }
+            if (y + e->h < bestTop || (y + e->h == bestTop && skyline[i].w < bestWidth))
+            {
+                bestSegment = i;
+                bestTop = y + e->h;
+                bestWidth = skyline[i].w;
+                bestY = y;
+            }
+        }
+
+        if (bestTop > maxHeight)
+        {
+            // page is full, start the next one with an empty skyline
+            page++;
+            skyline.clear();
+            skyline.push_back({0, 0, atlasWidth});
+            bestSegment = 0;
+            bestY = 0;
+        }
+
+        placeEntry(e, skyline[bestSegment].x, bestY, page);
+        addLevel(bestSegment, e->sx, e->sy, e->w, e->h);
+        atlasHeight = std::max(atlasHeight, e->ey);
+    }
+    return atlasHeight;
+}
+
+int SkylinePacker::fitAt(size_t segment, int w, int atlasWidth)
+{
+    // returns the y a glyph of width w rests at when its left edge is on this segment, or -1
+    int x = skyline[segment].x;
+    if (x + w > atlasWidth)
+    {
+        return -1;
+    }
+
+    int y = 0;
+    int widthLeft = w;
+    for (size_t i = segment; widthLeft > 0; ++i)
+    {
+        y = std::max(y, skyline[i].y);
+        widthLeft -= skyline[i].w;
+    }
+    return y;
+}
+
+void SkylinePacker::addLevel(size_t segment, int x, int y, int w, int h)
+{
+    skyline.insert(skyline.begin() + segment, {x, y + h, w});
+
+    // trim or remove the segments now covered by the new level
+    for (size_t i = segment + 1; i < skyline.size();)
+    {
+        int coveredTo = skyline[i - 1].x + skyline[i - 1].w;
+        if (skyline[i].x >= coveredTo)
+        {
+            break;
+        }
+        int shrink = coveredTo - skyline[i].x;
+        if (skyline[i].w <= shrink)
+        {
+            skyline.erase(skyline.begin() + i);
+            continue;
+        }
+        skyline[i].x += shrink;
+        skyline[i].w -= shrink;
+        break;
+    }
+
+    for (size_t i = 0; i + 1 < skyline.size();)
+    {
+        if (skyline[i].y == skyline[i + 1].y)
+        {
+            skyline[i].w += skyline[i + 1].w;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
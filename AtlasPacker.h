@@ -0,0 +1,78 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FontAtlas.h"
+
+// Places glyphs into an atlas of a fixed width by filling in page, sx, sy, ex and ey of each entry.
+// Pages are maxHeight tall, a packer moves on to the next page once a glyph no longer fits.
+class AtlasPacker {
+    public:
+
+    virtual ~AtlasPacker() = default;
+
+    // Packs entries in the given order and returns the tallest page height that was used.
+    // maxHeight is INT_MAX when the atlas should be a single page.
+    virtual int pack(std::vector<FontAtlasEntry *> &entries, int atlasWidth, int maxHeight) = 0;
+
+    // Creates a packer by command line name ("shelf", "maxrects" or "skyline"), nullptr if unknown.
+    static std::unique_ptr<AtlasPacker> create(const std::string &name);
+};
+
+// Rows of glyphs left to right, a new row starts when the next glyph does not fit.
+class ShelfPacker : public AtlasPacker {
+    public:
+
+    int pack(std::vector<FontAtlasEntry *> &entries, int atlasWidth, int maxHeight) override;
+};
+
+// MaxRects with the best short side fit heuristic. For a single page the bin starts at a height
+// estimated from the glyph area and grows until every glyph fits.
+class MaxRectsPacker : public AtlasPacker {
+    public:
+
+    struct Rect {
+        int x;
+        int y;
+        int w;
+        int h;
+    };
+
+    int pack(std::vector<FontAtlasEntry *> &entries, int atlasWidth, int maxHeight) override;
+
+    private:
+
+    bool packInto(std::vector<FontAtlasEntry *> &entries, int atlasWidth, int atlasHeight, bool spillPages);
+
+    bool findPosition(int w, int h, Rect &position);
+
+    void splitFreeRects(const Rect &used);
+
+    void pruneFreeRects();
+
+    std::vector<Rect> freeRects;
+    std::vector<Rect> newFreeRects;
+};
+
+// Skyline bottom-left: each glyph goes where its top edge ends up lowest.
+class SkylinePacker : public AtlasPacker {
+    public:
+
+    int pack(std::vector<FontAtlasEntry *> &entries, int atlasWidth, int maxHeight) override;
+
+    private:
+
+    struct Segment {
+        int x;
+        int y;
+        int w;
+    };
+
+    int fitAt(size_t segment, int w, int atlasWidth);
+
+    void addLevel(size_t segment, int x, int y, int w, int h);
+
+    std::vector<Segment> skyline;
+};
@@ -0,0 +1,173 @@
+#include "Batch.h"
+
+#include <map>
+
+#include "Parallel.h"
+
+// Values of a job key, given either as a single value or as an array under the singular or plural name.
+template <typename T>
+static std::vector<T> jobValues(const nlohmann::json &job, const std::string &single, const std::string &plural, T fallback)
+{
+    for (auto &key : {plural, single})
+    {
+        if (job.contains(key))
+        {
+            if (job[key].is_array())
+            {
+                return job[key].template get<std::vector<T>>();
+            }
+            return {job[key].template get<T>()};
+        }
+    }
+    return {fallback};
+}
+
+bool loadBatchJobs(const std::filesystem::path &jobFile, std::vector<BatchJob> &jobs, int &threads)
+{
+    std::ifstream file(jobFile);
+    if (!file)
+    {
+        std::cout << "loadBatchJobs -> Unable to open " << jobFile << std::endl;
+        return false;
+    }
+
+    nlohmann::json root;
+    try
+    {
+        root = nlohmann::json::parse(file);
+        threads = root.value("threads", threads);
+
+        // font paths are relative to the job file
+        std::filesystem::path base = jobFile.parent_path();
+        for (auto &job : root.at("jobs"))
+        {
+            std::filesystem::path font = base / job.at("font").get<std::string>();
+            int maxCodepoint = job.value("maxCodepoint", 128);
+            for (int size : jobValues<int>(job, "size", "sizes", 32))
+            {
+                for (auto &type : jobValues<std::string>(job, "type", "types", "sdf"))
+                {
+                    for (bool retina : jobValues<bool>(job, "retina", "retina", false))
+                    {
+                        jobs.push_back({font, size, maxCodepoint, retina, type});
+                    }
+                }
+            }
+        }
+    }
+    catch (const nlohmann::json::exception &e)
+    {
+        std::cout << "loadBatchJobs -> Invalid job file " << jobFile << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    // every job writes into the working directory, two jobs with the same output name would race
+    // on the same files. A job repeated exactly is dropped, a clash between different jobs is an error.
+    std::map<std::string, BatchJob> names;
+    std::vector<BatchJob> unique;
+    for (auto &job : jobs)
+    {
+        std::string name = FontAtlas::outputName(job.font, job.size, job.retina, job.type);
+        auto seen = names.find(name);
+        if (seen == names.end())
+        {
+            names.emplace(name, job);
+            unique.push_back(job);
+            continue;
+        }
+        const BatchJob &other = seen->second;
+        if (other.font != job.font || other.maxCodepoint != job.maxCodepoint || other.type != job.type)
+        {
+            std::cout << "loadBatchJobs -> " << other.font << " and " << job.font << " would both be written as " << name
+                      << std::endl;
+            return false;
+        }
+    }
+    jobs.swap(unique);
+    return true;
+}
+
+int runBatch(const std::filesystem::path &jobFile, FontAtlasSettings settings)
+{
+    int threads = 0;
+    std::vector<BatchJob> jobs;
+    if (!loadBatchJobs(jobFile, jobs, threads))
+    {
+        return 1;
+    }
+    threads = resolveThreadCount(threads);
+
+    // whole atlases run in parallel, so each one renders on a single thread
+    settings.threads = 1;
+
+    std::cout << "runBatch -> Running " << jobs.size() << " jobs on " << threads << " thread(s)." << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // every font is mapped once and shared by all the faces opened over it
+    std::map<std::filesystem::path, std::shared_ptr<FontFile>> fontFiles;
+    for (auto &job : jobs)
+    {
+        if (!fontFiles.count(job.font))
+        {
+            fontFiles[job.font] = FontFile::open(job.font);
+        }
+    }
+
+    struct Worker {
+        FT_Library ft = nullptr;
+        std::map<std::filesystem::path, FT_Face> faces;
+    };
+    std::vector<Worker> workers(threads);
+    std::vector<char> failed(jobs.size(), false);
+
+    parallelForEach(jobs.size(), threads, [&](int w, size_t j) {
+        Worker &worker = workers[w];
+        const BatchJob &job = jobs[j];
+        if (!worker.ft && FT_Init_FreeType(&worker.ft))
+        {
+            std::cout << "runBatch -> Could not init FreeType Library" << std::endl;
+            worker.ft = nullptr;
+            failed[j] = true;
+            return;
+        }
+
+        const auto &fontFile = fontFiles.at(job.font);
+        auto face = worker.faces.find(job.font);
+        if (face == worker.faces.end())
+        {
+            FT_Face loaded;
+            if (!fontFile || FT_New_Memory_Face(worker.ft, fontFile->data(), (FT_Long)fontFile->size(), 0, &loaded))
+            {
+                std::cout << "runBatch -> Failed to load font " << job.font << std::endl;
+                failed[j] = true;
+                return;
+            }
+            face = worker.faces.emplace(job.font, loaded).first;
+        }
+
+        FontAtlas atlas(worker.ft, face->second, fontFile, job.font, job.size, job.maxCodepoint, job.retina, job.type, settings);
+        failed[j] = !atlas.succeeded;
+    });
+
+    for (auto &worker : workers)
+    {
+        for (auto &face : worker.faces)
+        {
+            FT_Done_Face(face.second);
+        }
+        if (worker.ft)
+        {
+            FT_Done_FreeType(worker.ft);
+        }
+    }
+
+    int failures = 0;
+    for (char f : failed)
+    {
+        failures += f;
+    }
+    std::cout << "runBatch -> Finished " << jobs.size() - failures << " of " << jobs.size() << " jobs in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count()
+              << " ms." << std::endl;
+    return failures ? 1 : 0;
+}
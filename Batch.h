@@ -0,0 +1,23 @@
+#pragma once
+
+#include <filesystem>
+
+#include "FontAtlas.h"
+
+struct BatchJob {
+    std::filesystem::path font;
+    int size;
+    int maxCodepoint;
+    bool retina;
+    std::string type;
+};
+
+// Reads a job file into one BatchJob per font, size, type and retina combination. threads is set
+// when the file gives a thread count. Font paths are resolved relative to the job file. Fails if
+// two different jobs would write files of the same name, exact repeats are dropped.
+bool loadBatchJobs(const std::filesystem::path &jobFile, std::vector<BatchJob> &jobs, int &threads);
+
+// Generates every atlas listed in a JSON job file within this process. Jobs run on a pool of
+// threads and each thread keeps its FT_Library and faces open across sizes and types. settings
+// apply to every job. Returns a process exit code.
+int runBatch(const std::filesystem::path &jobFile, FontAtlasSettings settings);
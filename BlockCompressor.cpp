@@ -0,0 +1,171 @@
+#include "BlockCompressor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BLOCK_COMPRESSOR_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BLOCK_COMPRESSOR_NEON
+#endif
+
+#include "Parallel.h"
+
+size_t bc4Size(int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+}
+
+static void blockMinMax(const unsigned char texels[16], int &lo, int &hi)
+{
+#if defined(BLOCK_COMPRESSOR_SSE2)
+    __m128i v = _mm_loadu_si128((const __m128i *)texels);
+    __m128i mn = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+    __m128i mx = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 2));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 2));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 1));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 1));
+    lo = _mm_cvtsi128_si32(mn) & 0xff;
+    hi = _mm_cvtsi128_si32(mx) & 0xff;
+#elif defined(BLOCK_COMPRESSOR_NEON)
+    uint8x16_t v = vld1q_u8(texels);
+    lo = vminvq_u8(v);
+    hi = vmaxvq_u8(v);
+#else
+    lo = 255;
+    hi = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        lo = std::min(lo, (int)texels[i]);
+        hi = std::max(hi, (int)texels[i]);
+    }
+#endif
+}
+
+// Picks the nearest palette entry for every texel, returns the summed squared error and the 48
+// bits of 3 bit indices.
+static int quantise(const unsigned char texels[16], const int palette[8], uint64_t &indices)
+{
+    int error = 0;
+    indices = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0;
+        int bestError = INT32_MAX;
+        for (int p = 0; p < 8; ++p)
+        {
+            int d = texels[i] - palette[p];
+            if (d * d < bestError)
+            {
+                bestError = d * d;
+                best = p;
+            }
+        }
+        error += bestError;
+        indices |= (uint64_t)best << (3 * i);
+    }
+    return error;
+}
+
+static void encodeBlock(const unsigned char texels[16], unsigned char *block)
+{
+    int lo, hi;
+    blockMinMax(texels, lo, hi);
+    if (lo == hi)
+    {
+        block[0] = hi;
+        block[1] = lo;
+        memset(block + 2, 0, 6);
+        return;
+    }
+
+    // red0 > red1: eight values spread from the block maximum to its minimum
+    int palette[8] = {hi, lo};
+    for (int i = 1; i < 7; ++i)
+    {
+        palette[i + 1] = ((7 - i) * hi + i * lo + 3) / 7;
+    }
+    uint64_t indices;
+    int error = quantise(texels, palette, indices);
+    int red0 = hi;
+    int red1 = lo;
+
+    // red0 <= red1: six values between the extremes that are not 0 or 255, plus exact 0 and 255,
+    // which suits the flat background and saturated interior of SDF and bitmap glyphs
+    if (lo == 0 || hi == 255)
+    {
+        int innerLo = 255;
+        int innerHi = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            if (texels[i] != 0 && texels[i] != 255)
+            {
+                innerLo = std::min(innerLo, (int)texels[i]);
+                innerHi = std::max(innerHi, (int)texels[i]);
+            }
+        }
+        if (innerLo > innerHi)
+        {
+            innerLo = innerHi = lo == 0 ? 0 : 255;
+        }
+
+        int palette6[8] = {innerLo, innerHi};
+        for (int i = 1; i < 5; ++i)
+        {
+            palette6[i + 1] = ((5 - i) * innerLo + i * innerHi + 2) / 5;
+        }
+        palette6[6] = 0;
+        palette6[7] = 255;
+        uint64_t indices6;
+        int error6 = quantise(texels, palette6, indices6);
+        if (error6 < error)
+        {
+            error = error6;
+            indices = indices6;
+            red0 = innerLo;
+            red1 = innerHi;
+        }
+    }
+
+    block[0] = red0;
+    block[1] = red1;
+    for (int i = 0; i < 6; ++i)
+    {
+        block[2 + i] = (indices >> (8 * i)) & 0xff;
+    }
+}
+
+void compressBC4(const unsigned char *pixels, int width, int height, unsigned char *blocks, int threads)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    parallelFor(blocksY, resolveThreadCount(threads), [&](int shard, size_t begin, size_t end) {
+        unsigned char texels[16];
+        for (size_t by = begin; by < end; ++by)
+        {
+            for (int bx = 0; bx < blocksX; ++bx)
+            {
+                for (int y = 0; y < 4; ++y)
+                {
+                    const unsigned char *row = pixels + (size_t)std::min((int)by * 4 + y, height - 1) * width;
+                    if (bx * 4 + 4 <= width)
+                    {
+                        memcpy(texels + y * 4, row + bx * 4, 4);
+                        continue;
+                    }
+                    for (int x = 0; x < 4; ++x)
+                    {
+                        texels[y * 4 + x] = row[std::min(bx * 4 + x, width - 1)];
+                    }
+                }
+                encodeBlock(texels, blocks + ((size_t)by * blocksX + bx) * 8);
+            }
+        }
+    });
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+// Bytes taken by a width x height image in BC4, 8 bytes per 4x4 block. Partial blocks at the right
+// and bottom edges count as whole blocks.
+size_t bc4Size(int width, int height);
+
+// Compresses a single channel image to BC4 (RGTC1 unsigned) blocks, row by row of blocks. Pixels
+// of partial edge blocks repeat the last row or column. Rows of blocks are split over `threads`
+// threads, 0 = one per hardware thread.
+void compressBC4(const unsigned char *pixels, int width, int height, unsigned char *blocks, int threads);
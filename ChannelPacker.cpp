@@ -0,0 +1,194 @@
+#include "ChannelPacker.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CHANNEL_PACKER_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CHANNEL_PACKER_NEON
+#endif
+
+#include <nlohmann/json.hpp>
+#include <stb_image.h>
+
+void interleaveChannels(const std::vector<const unsigned char *> &planes, int width, int height, unsigned char *rgba)
+{
+    static const unsigned char zeros[64] = {};
+    size_t pixels = (size_t)width * height;
+    const unsigned char *src[4];
+    size_t srcStep[4];
+    for (int c = 0; c < 4; ++c)
+    {
+        bool present = c < (int)planes.size() && planes[c];
+        src[c] = present ? planes[c] : zeros;
+        srcStep[c] = present ? 1 : 0;
+    }
+
+    size_t i = 0;
+#if defined(CHANNEL_PACKER_SSE2)
+    for (; i + 16 <= pixels; i += 16)
+    {
+        __m128i r = _mm_loadu_si128((const __m128i *)(src[0] + i * srcStep[0]));
+        __m128i g = _mm_loadu_si128((const __m128i *)(src[1] + i * srcStep[1]));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src[2] + i * srcStep[2]));
+        __m128i a = _mm_loadu_si128((const __m128i *)(src[3] + i * srcStep[3]));
+        __m128i rgLo = _mm_unpacklo_epi8(r, g);
+        __m128i rgHi = _mm_unpackhi_epi8(r, g);
+        __m128i baLo = _mm_unpacklo_epi8(b, a);
+        __m128i baHi = _mm_unpackhi_epi8(b, a);
+        __m128i *out = (__m128i *)(rgba + i * 4);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(rgLo, baLo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+    }
+#elif defined(CHANNEL_PACKER_NEON)
+    for (; i + 16 <= pixels; i += 16)
+    {
+        uint8x16x4_t v;
+        v.val[0] = vld1q_u8(src[0] + i * srcStep[0]);
+        v.val[1] = vld1q_u8(src[1] + i * srcStep[1]);
+        v.val[2] = vld1q_u8(src[2] + i * srcStep[2]);
+        v.val[3] = vld1q_u8(src[3] + i * srcStep[3]);
+        vst4q_u8(rgba + i * 4, v);
+    }
+#endif
+    for (; i < pixels; ++i)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            rgba[i * 4 + c] = src[c][i * srcStep[c]];
+        }
+    }
+}
+
+int combineAtlases(const std::vector<std::string> &manifests, const std::string &outname, const PngOptions &png)
+{
+    if (manifests.empty() || manifests.size() > 4)
+    {
+        std::cout << "combineAtlases -> Expected between 1 and 4 manifests, got " << manifests.size() << std::endl;
+        return 1;
+    }
+
+    std::vector<nlohmann::json> loaded;
+    std::vector<unsigned char *> images;
+    std::vector<std::pair<int, int>> sizes; // decoded size of every image, the manifest may disagree
+    int width = 0;
+    int height = 0;
+    bool failed = false;
+    for (auto &name : manifests)
+    {
+        std::filesystem::path manifestPath(name);
+        std::ifstream file(manifestPath);
+        nlohmann::json manifest = nlohmann::json::parse(file, nullptr, false);
+        if (!file || manifest.is_discarded() || !manifest.contains("atlas"))
+        {
+            std::cout << "combineAtlases -> Unable to read manifest " << name << std::endl;
+            failed = true;
+            break;
+        }
+        if (manifest.contains("pages") && manifest["pages"].size() > 1)
+        {
+            std::cout << "combineAtlases -> " << name << " has several pages, only single page atlases can be combined"
+                      << std::endl;
+            failed = true;
+            break;
+        }
+        if (manifest.contains("channels"))
+        {
+            std::cout << "combineAtlases -> " << name << " is already channel packed, only single channel atlases can be combined"
+                      << std::endl;
+            failed = true;
+            break;
+        }
+
+        std::filesystem::path imagePath = manifestPath.parent_path() / manifest["atlas"].get<std::string>();
+        int w, h, components;
+        unsigned char *image = stbi_load(imagePath.string().c_str(), &w, &h, &components, 1);
+        if (!image)
+        {
+            std::cout << "combineAtlases -> Unable to load " << imagePath << std::endl;
+            failed = true;
+            break;
+        }
+        images.push_back(image);
+        if (components != 1)
+        {
+            std::cout << "combineAtlases -> " << imagePath << " has " << components
+                      << " channels, only single channel atlases can be combined" << std::endl;
+            failed = true;
+            break;
+        }
+        width = std::max(width, w);
+        height = std::max(height, h);
+        loaded.push_back(manifest);
+        sizes.push_back({w, h});
+    }
+
+    if (!failed)
+    {
+        // atlases may differ in size, each is copied into the top left of a full size plane
+        std::vector<std::vector<unsigned char>> planes(images.size(), std::vector<unsigned char>((size_t)width * height, 0));
+        std::vector<const unsigned char *> planePointers;
+        for (size_t c = 0; c < images.size(); ++c)
+        {
+            auto [w, h] = sizes[c];
+            for (int y = 0; y < h; ++y)
+            {
+                memcpy(planes[c].data() + (size_t)y * width, images[c] + (size_t)y * w, w);
+            }
+            planePointers.push_back(planes[c].data());
+        }
+
+        std::vector<unsigned char> rgba((size_t)width * height * 4);
+        interleaveChannels(planePointers, width, height, rgba.data());
+
+        std::string pngOutName = outname + ".png";
+        std::filesystem::remove(pngOutName);
+        if (!writePng(pngOutName, rgba.data(), width, height, 4, png))
+        {
+            std::cout << "combineAtlases -> Unable to write " << pngOutName << std::endl;
+            failed = true;
+        }
+        else
+        {
+            std::cout << "combineAtlases -> written " << pngOutName << std::endl;
+        }
+
+        for (size_t c = 0; c < loaded.size() && !failed; ++c)
+        {
+            nlohmann::json &manifest = loaded[c];
+            manifest["atlas"] = pngOutName;
+            manifest["width"] = width;
+            manifest["height"] = height;
+            manifest["channel"] = c;
+            if (manifest.contains("pages"))
+            {
+                manifest["pages"] = nlohmann::json::array({pngOutName});
+            }
+            for (auto &ch : manifest["characters"])
+            {
+                ch["ch"] = c;
+            }
+
+            std::string jsonOutName = outname + "_" + std::filesystem::path(manifests[c]).filename().string();
+            std::filesystem::remove(jsonOutName);
+            std::ofstream manifestFile(jsonOutName, std::ios::out | std::ios::binary);
+            std::string output = manifest.dump();
+            manifestFile.write(output.c_str(), output.size());
+            std::cout << "combineAtlases -> written " << jsonOutName << std::endl;
+        }
+    }
+
+    for (auto image : images)
+    {
+        stbi_image_free(image);
+    }
+    return failed ? 1 : 0;
+}
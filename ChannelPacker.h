@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "PngEncoder.h"
+
+// Interleaves up to four single channel planes of width x height into one RGBA image. planes[c]
+// becomes channel c, a missing or nullptr plane leaves its channel at 0.
+void interleaveChannels(const std::vector<const unsigned char *> &planes, int width, int height, unsigned char *rgba);
+
+// Combines up to four single page atlases into the R, G, B and A channels of <outname>.png and
+// writes a copy of every manifest, <outname>_<manifest name>.json, that points at the combined
+// texture and gives each character its channel as "ch". Returns a process exit code.
+int combineAtlases(const std::vector<std::string> &manifests, const std::string &outname, const PngOptions &png = {});
@@ -1,7 +1,12 @@
 #include "FontAtlas.h"
 
+#include <climits>
+#include <unordered_map>
+
 #include <ft2build.h>
 #include FT_FREETYPE_H  
+#include FT_MODULE_H
+#include FT_OUTLINE_H
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -11,42 +16,100 @@
 
 #include <nlohmann/json.hpp>
 
-bool FontAtlasEntry::pointIsInside(int x, int y)
+#include "AtlasCache.h"
+#include "AtlasPacker.h"
+#include "ChannelPacker.h"
+#include "FontAtlasBinary.h"
+#include "GlyphArena.h"
+#include "GlyphCache.h"
+#include "Hash.h"
+#include "JsonStreamWriter.h"
+#include "LittleEndian.h"
+#include "Parallel.h"
+#include "SdfGenerator.h"
+#include "TextureWriter.h"
+
+// whitespace and control glyphs have no pixels, they only carry metrics and keep a 0,0,0,0 rectangle
+bool FontAtlasEntry::isEmpty() const
 {
-    return (x >= sx) && (x <= ex) && (y >= sy) && (y <= ey);
+    return w == 0 || h == 0;
 }
 
-void FontAtlas::initFreetype()
+// Copies the top left width x height pixels of an 8 bit FreeType bitmap row by row into dst.
+// FreeType rows are pitch bytes apart, which may be padded beyond the width or negative for
+// bottom-up bitmaps.
+static void copyBitmapRows(const FT_Bitmap &bitmap, unsigned char *dst, int dstPitch, int width, int height)
 {
-    if (FT_Init_FreeType(&ft))
+    for (int y = 0; y < height; ++y)
     {
-        std::cout << "FontAtlas::initFreetype Could not init FreeType Library" << std::endl;
-        return;
+        const unsigned char *row = bitmap.pitch >= 0 ? bitmap.buffer + y * bitmap.pitch
+                                                     : bitmap.buffer + (bitmap.rows - 1 - y) * -bitmap.pitch;
+        memcpy(dst + y * dstPitch, row, width);
     }
+}
 
-    if (FT_New_Face(ft, path.c_str(), 0, &face))
+// Placement of an edt distance field: the pixel bounds of the loaded outline grown by the spread
+// on every side. It depends on the outline alone, so -direct measures exactly what it renders.
+static void edtPlacement(FT_GlyphSlot slot, int spread, int &width, int &height, int &bearingX, int &bearingY)
+{
+    if (slot->outline.n_points == 0)
     {
-        std::cout << "FontAtlas::initFreetype Failed to load font" << std::endl;
+        width = height = bearingX = bearingY = 0;
         return;
     }
-    outname = path.filename().stem().string() + "_" + std::to_string(size);
-    if(retina) {
-        outname += "_retina";
+    FT_BBox box;
+    FT_Outline_Get_CBox(&slot->outline, &box);
+    int left = (int)(box.xMin >> 6);
+    int bottom = (int)(box.yMin >> 6);
+    int right = (int)((box.xMax + 63) >> 6);
+    int top = (int)((box.yMax + 63) >> 6);
+    width = right - left + 2 * spread;
+    height = top - bottom + 2 * spread;
+    bearingX = left - spread;
+    bearingY = top + spread;
+}
+
+bool FontAtlas::initFreetype()
+{
+    // a borrowed library and face are already loaded, see the second constructor
+    if (ownsFreetype)
+    {
+        if (FT_Init_FreeType(&ft))
+        {
+            std::cout << "FontAtlas::initFreetype Could not init FreeType Library" << std::endl;
+            return false;
+        }
+
+        if (!openFontFile() || FT_New_Memory_Face(ft, fontFile->data(), (FT_Long)fontFile->size(), 0, &face))
+        {
+            std::cout << "FontAtlas::initFreetype Failed to load font" << std::endl;
+            FT_Done_FreeType(ft);
+            return false;
+        }
     }
-    if(type == 1) {
-        outname += "_bitmap";
+    sdfSpread = 8;
+    configureSdf(ft);
+    FT_Property_Get(ft, "sdf", "spread", &sdfSpread);
+    if (settings.sdfEngine == "edt" && settings.spread > 0)
+    {
+        // not bound by the range FreeType accepts
+        sdfSpread = settings.spread;
     }
 
     totalGlyphPixels = 0;
     averageGlpyhHeight = 0;
     averageGlpyhWidth = 0;
     std::cout << "FontAtlas::initFreetype() -> Loaded " << path << " successfully." << std::endl;
+    return true;
 }
 
 void FontAtlas::freeFreetype()
 {
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
+    if (ownsFreetype)
+    {
+        FT_Done_Face(face);
+        FT_Done_FreeType(ft);
+    }
 }
 
 void FontAtlas::loadAtlasEntries(int size, int maxCodepoint)
@@ -58,8 +121,6 @@ void FontAtlas::loadAtlasEntries(int size, int maxCodepoint)
     FT_UInt index;
     FT_ULong c = FT_Get_First_Char(face, &index);
 
-    //TODO: We can do this in parallel
-
     std::vector<std::pair<FT_ULong, FT_ULong>> validChars;
     while (index)
     {
@@ -70,58 +131,403 @@ void FontAtlas::loadAtlasEntries(int size, int maxCodepoint)
         c = FT_Get_Next_Char(face, c, &index);
     }
 
-    std::cout << "Rendering " << validChars.size() << " glyphs..." << std::endl;
+    // glyphs already in the glyph cache are copied from it, the rest are rendered
+    std::unique_ptr<GlyphCache> glyphCache;
+    if (!settings.glyphCacheDir.empty() && !settings.directRasterize && openFontFile())
+    {
+        std::string renderMode = type == 1                     ? "bitmap"
+                                 : settings.sdfEngine == "edt" ? "edt" + std::to_string(sdfSpread) + "x" +
+                                                                     std::to_string(settings.oversample)
+                                                               : "sdf" + std::to_string(sdfSpread);
+        glyphCache = std::make_unique<GlyphCache>(settings.glyphCacheDir, fontFile->hash(), size, renderMode);
+        glyphCache->load();
+    }
 
-    for(auto &c : validChars) {
-        //TODO: handle flag for SDF or normal render, add commandline, add entry in manifest
-        
-        int32_t renderTarget = type == 0 ? FT_LOAD_TARGET_(FT_RENDER_MODE_SDF) : 0;
-        if (FT_Load_Char(face, c.first, FT_LOAD_RENDER | renderTarget))
+    // codepoints that map to a glyph index seen before (spaces, compatibility forms) are neither
+    // rendered nor packed, they share the rectangle of the first codepoint with that index
+    std::vector<FontAtlasEntry> entries(validChars.size());
+    std::vector<char> loaded(validChars.size(), 0);
+    std::vector<size_t> firstWithIndex(validChars.size());
+    std::unordered_map<FT_ULong, size_t> indexSeen;
+    std::vector<size_t> toRender;
+    for (size_t i = 0; i < validChars.size(); ++i)
+    {
+        firstWithIndex[i] = indexSeen.emplace(validChars[i].second, i).first->second;
+        if (firstWithIndex[i] != i)
         {
-            std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
             continue;
         }
 
-        int glyphWidth = face->glyph->bitmap.width;
-        int glyphHeight = face->glyph->bitmap.rows;
-
-        unsigned char *data = new unsigned char[glyphWidth * glyphHeight];
-        memcpy(data, face->glyph->bitmap.buffer, glyphWidth * glyphHeight);
-
-        atlasEntries.push_back({
-            (int)c.first,
-            (int)c.second,
-            0,
-            0,
-            0,
-            0,
-            glyphWidth,
-            glyphHeight,
-            size,
-            data,
-            face->glyph->bitmap_left,
-            face->glyph->bitmap_top,
-            (int)((float)face->glyph->advance.x)
-        });
+        const GlyphCache::Glyph *cached = glyphCache ? glyphCache->find(validChars[i].second) : nullptr;
+        if (!cached)
+        {
+            toRender.push_back(i);
+            continue;
+        }
 
-        totalGlyphPixels += glyphWidth * glyphHeight;
-        averageGlpyhWidth += glyphWidth;
-        averageGlpyhHeight += glyphHeight;
-        
+        unsigned char *data = glyphArena.allocate(cached->w * cached->h);
+        if (data)
+        {
+            memcpy(data, glyphCache->glyphPixels(*cached), cached->w * cached->h);
+        }
+        entries[i] = {(int)validChars[i].first, (int)validChars[i].second, 0, 0, 0, 0, cached->w, cached->h, size,
+                      data, cached->bearingX, cached->bearingY, cached->advance};
+        loaded[i] = 1;
+    }
+
+    stats["glyphs"]["fromGlyphCache"] = std::count(loaded.begin(), loaded.end(), 1);
+
+    // each shard renders a contiguous run of the remaining glyphs through its own FT_Face and
+    // writes them into their own slots, so entries stay in codepoint order
+    int shards = shardCount(toRender.size());
+    std::vector<GlyphArena> shardArenas(shards);
+
+    std::cout << (settings.directRasterize ? "Measuring " : "Rendering ") << toRender.size() << " glyphs on "
+              << shards << " thread(s)..." << std::endl;
+
+    runShards(toRender.size(), shards, [&](int shard, FT_Face shardFace, size_t begin, size_t end) {
+        for (size_t r = begin; r < end; ++r)
+        {
+            size_t i = toRender[r];
+            loaded[i] = renderGlyph(shardFace, validChars[i].first, validChars[i].second, shardArenas[shard], entries[i]);
+        }
+    });
+
+    for (auto &arena : shardArenas)
+    {
+        glyphArena.adopt(arena);
+    }
+
+    std::vector<int> position(entries.size(), -1);
+    int duplicates = 0;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        size_t first = firstWithIndex[i];
+        if (!loaded[first])
+        {
+            continue;
+        }
+        position[i] = (int)atlasEntries.size();
+        if (first != i)
+        {
+            FontAtlasEntry entry = entries[first];
+            entry.code = (int)validChars[i].first;
+            entry.data = nullptr;
+            entry.duplicateOf = position[first];
+            atlasEntries.push_back(entry);
+            duplicates++;
+            continue;
+        }
+        atlasEntries.push_back(entries[i]);
+    }
+    if (duplicates)
+    {
+        std::cout << "FontAtlas::loadAtlasEntries() -> " << duplicates << " codepoints share a glyph index with another."
+                  << std::endl;
+    }
+
+    if (settings.dedupeBitmaps)
+    {
+        dedupeBitmaps();
+    }
+
+    // only glyphs that get their own rectangle count towards the layout estimates
+    int packed = 0;
+    int empty = 0;
+    for (auto &entry : atlasEntries)
+    {
+        if (entry.duplicateOf >= 0 || entry.isEmpty())
+        {
+            empty += entry.duplicateOf < 0;
+            continue;
+        }
+        totalGlyphPixels += entry.w * entry.h;
+        averageGlpyhWidth += entry.w;
+        averageGlpyhHeight += entry.h;
+        packed++;
+    }
+    averageGlpyhWidth /= (float)std::max(1, packed);
+    averageGlpyhHeight /= (float)std::max(1, packed);
+    std::cout << "FontAtlas::loadAtlasEntries() -> " << packed << " of " << atlasEntries.size()
+              << " glyphs need a rectangle." << std::endl;
+
+    stats["glyphs"]["codepoints"] = validChars.size();
+    stats["glyphs"]["rendered"] = toRender.size();
+    stats["glyphs"]["indexDuplicates"] = duplicates;
+    stats["glyphs"]["empty"] = empty;
+    stats["glyphs"]["packed"] = packed;
+    stats["bytes"]["glyphArena"] = glyphArena.bytesAllocated();
+
+    if (glyphCache)
+    {
+        for (size_t i : toRender)
+        {
+            if (loaded[i])
+            {
+                auto &e = entries[i];
+                glyphCache->add(e.index, {e.w, e.h, e.bearingX, e.bearingY, e.advance, 0}, e.data);
+            }
+        }
+        glyphCache->save();
+    }
+}
+
+void FontAtlas::dedupeBitmaps()
+{
+    if (settings.directRasterize)
+    {
+        std::cout << "FontAtlas::dedupeBitmaps() -> Glyphs are only measured with -direct, skipping." << std::endl;
+        return;
+    }
+
+    // glyphs are bucketed by a hash of their size and pixels, a hash match is confirmed with memcmp
+    std::unordered_map<uint64_t, std::vector<int>> buckets;
+    int duplicates = 0;
+    for (size_t e = 0; e < atlasEntries.size(); ++e)
+    {
+        auto &i = atlasEntries[e];
+        if (i.duplicateOf >= 0 || !i.data || i.isEmpty())
+        {
+            continue;
+        }
+
+        int dims[2] = {i.w, i.h};
+        uint64_t hash = hashBytes(i.data, (size_t)i.w * i.h, hashBytes(dims, sizeof(dims)));
+        auto &bucket = buckets[hash];
+        for (int other : bucket)
+        {
+            auto &o = atlasEntries[other];
+            if (o.w == i.w && o.h == i.h && memcmp(o.data, i.data, (size_t)i.w * i.h) == 0)
+            {
+                i.duplicateOf = other;
+                break;
+            }
+        }
+        if (i.duplicateOf >= 0)
+        {
+            duplicates++;
+            continue;
+        }
+        bucket.push_back((int)e);
+    }
+
+    // codepoints that shared this glyph index follow it to the rectangle it now shares
+    for (auto &i : atlasEntries)
+    {
+        if (i.duplicateOf >= 0 && atlasEntries[i.duplicateOf].duplicateOf >= 0)
+        {
+            i.duplicateOf = atlasEntries[i.duplicateOf].duplicateOf;
+        }
+    }
+
+    std::cout << "FontAtlas::dedupeBitmaps() -> " << duplicates << " glyphs have the same bitmap as another."
+              << std::endl;
+    stats["glyphs"]["bitmapDuplicates"] = duplicates;
+}
+
+void FontAtlas::resolveDuplicates()
+{
+    for (auto &i : atlasEntries)
+    {
+        if (i.duplicateOf < 0)
+        {
+            continue;
+        }
+        auto &packed = atlasEntries[i.duplicateOf];
+        i.page = packed.page;
+        i.sx = packed.sx;
+        i.sy = packed.sy;
+        i.ex = packed.ex;
+        i.ey = packed.ey;
+    }
+}
+
+int FontAtlas::shardCount(size_t glyphs)
+{
+    return std::min(resolveThreadCount(settings.threads), std::max(1, (int)glyphs / 64));
+}
+
+void FontAtlas::runShards(size_t glyphs, int shards, const std::function<void(int, FT_Face, size_t, size_t)> &fn)
+{
+    int renderSize = size * (retina ? 2 : 1);
+    if (shards > 1 && !openFontFile())
+    {
+        shards = 1;
+    }
+    // ranges of shards that could not open a face, rendered through ours once the others finish
+    std::vector<std::pair<size_t, size_t>> fallback(shards, {0, 0});
+    parallelFor(glyphs, shards, [&](int shard, size_t begin, size_t end) {
+        // FT_Face is not thread safe, shard 0 borrows ours and every other shard opens its own
+        // over the same mapped font file
+        FT_Library shardFt = ft;
+        FT_Face shardFace = face;
+        if (shard != 0)
+        {
+            if (FT_Init_FreeType(&shardFt))
+            {
+                std::cout << "FontAtlas::runShards Could not init FreeType Library for shard " << shard << std::endl;
+                fallback[shard] = {begin, end};
+                return;
+            }
+            if (FT_New_Memory_Face(shardFt, fontFile->data(), (FT_Long)fontFile->size(), 0, &shardFace))
+            {
+                std::cout << "FontAtlas::runShards Failed to load font for shard " << shard << std::endl;
+                FT_Done_FreeType(shardFt);
+                fallback[shard] = {begin, end};
+                return;
+            }
+            configureSdf(shardFt);
+            FT_Set_Char_Size(shardFace, renderSize * 64, renderSize * 64, 0, 0);
+        }
+
+        fn(shard, shardFace, begin, end);
+
+        if (shard != 0)
+        {
+            FT_Done_Face(shardFace);
+            FT_Done_FreeType(shardFt);
+        }
+    });
+
+    // the face is the same font at the same size, so the output does not change
+    for (int shard = 1; shard < (int)fallback.size(); ++shard)
+    {
+        if (fallback[shard].first < fallback[shard].second)
+        {
+            fn(shard, face, fallback[shard].first, fallback[shard].second);
+        }
+    }
+}
+
+bool FontAtlas::renderGlyph(FT_Face face, FT_ULong code, FT_UInt index, GlyphArena &arena, FontAtlasEntry &entry)
+{
+    // the edt engine only needs the outline, it rasterizes and transforms it itself
+    bool edt = type == 0 && settings.sdfEngine == "edt";
+    int32_t renderTarget = type == 0 && !edt ? FT_LOAD_TARGET_(FT_RENDER_MODE_SDF) : 0;
+    int32_t renderFlag = edt ? FT_LOAD_NO_BITMAP : settings.directRasterize ? 0 : FT_LOAD_RENDER;
+    if (FT_Load_Char(face, code, renderFlag | renderTarget) ||
+        (edt && face->glyph->format != FT_GLYPH_FORMAT_OUTLINE))
+    {
+        std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
+        ftErrors++;
+        return false;
+    }
+
+    int glyphWidth = face->glyph->bitmap.width;
+    int glyphHeight = face->glyph->bitmap.rows;
+    int bearingX = face->glyph->bitmap_left;
+    int bearingY = face->glyph->bitmap_top;
+
+    unsigned char *data = nullptr;
+    if (edt)
+    {
+        edtPlacement(face->glyph, sdfSpread, glyphWidth, glyphHeight, bearingX, bearingY);
+        if (!settings.directRasterize)
+        {
+            data = arena.allocate(glyphWidth * glyphHeight);
+            if (data && !renderEdt(face->glyph, glyphWidth, glyphHeight, bearingX, bearingY, data, glyphWidth))
+            {
+                memset(data, 0, glyphWidth * glyphHeight);
+            }
+        }
+    }
+    else if (settings.directRasterize)
+    {
+        // measure only: FT_Load_Char presets the bitmap metrics of an outline glyph without
+        // rendering it. The SDF renderer grows non-empty bitmaps by its spread on every side.
+        if (type == 0 && glyphWidth > 0 && glyphHeight > 0)
+        {
+            glyphWidth += 2 * sdfSpread;
+            glyphHeight += 2 * sdfSpread;
+            bearingX -= sdfSpread;
+            bearingY += sdfSpread;
+        }
+    }
+    else
+    {
+        data = arena.allocate(glyphWidth * glyphHeight);
+        if (data)
+        {
+            copyBitmapRows(face->glyph->bitmap, data, glyphWidth, glyphWidth, glyphHeight);
+        }
     }
-    averageGlpyhWidth /= (float)atlasEntries.size();
-    averageGlpyhHeight /= (float)atlasEntries.size();
+
+    entry = {
+        (int)code,
+        (int)index,
+        0,
+        0,
+        0,
+        0,
+        glyphWidth,
+        glyphHeight,
+        size * (retina ? 2 : 1),
+        data,
+        bearingX,
+        bearingY,
+        (int)((float)face->glyph->advance.x)
+    };
+    return true;
+}
+
+void FontAtlas::configureSdf(FT_Library library)
+{
+    if (settings.spread > 0 && settings.sdfEngine == "freetype")
+    {
+        FT_Int spread = settings.spread;
+        FT_Property_Set(library, "sdf", "spread", &spread);
+        FT_Property_Set(library, "bsdf", "spread", &spread);
+    }
+}
+
+bool FontAtlas::renderEdt(FT_GlyphSlot slot, int width, int height, int bearingX, int bearingY, unsigned char *dst, int dstPitch)
+{
+    if (width <= 0 || height <= 0)
+    {
+        return true;
+    }
+
+    // move the bottom left of the field to the origin and scale up, then rasterize the coverage
+    // of exactly the field's area at the higher resolution
+    int oversample = settings.oversample;
+    thread_local std::vector<unsigned char> coverage;
+    coverage.assign((size_t)width * height * oversample * oversample, 0);
+    FT_Outline_Translate(&slot->outline, -bearingX * 64, -(bearingY - height) * 64);
+    FT_Matrix scale = {oversample << 16, 0, 0, oversample << 16};
+    FT_Outline_Transform(&slot->outline, &scale);
+
+    FT_Bitmap bitmap = {};
+    bitmap.rows = height * oversample;
+    bitmap.width = width * oversample;
+    bitmap.pitch = width * oversample;
+    bitmap.buffer = coverage.data();
+    bitmap.num_grays = 256;
+    bitmap.pixel_mode = FT_PIXEL_MODE_GRAY;
+    if (FT_Outline_Get_Bitmap(slot->library, &slot->outline, &bitmap))
+    {
+        std::cout << "ERROR::FREETYTPE: Failed to rasterize outline" << std::endl;
+        ftErrors++;
+        return false;
+    }
+
+    coverageToSdf(coverage.data(), bitmap.pitch, width, height, oversample, sdfSpread, dst, dstPitch);
+    return true;
 }
 
 void FontAtlas::estimateBounds()
 {
+    calculateGutters();
     // std::cout << totalGlyphPixels << std::endl;
     float glyphAspectRatio = averageGlpyhWidth / averageGlpyhHeight;
     float bestGuessWastage = std::abs(1.f - glyphAspectRatio);
 
     float averageWastage = 1. + bestGuessWastage; // from observation
-    float estimatedWidth = sqrt(totalGlyphPixels) * averageWastage;
+    float estimatedWidth = sqrt(totalCellPixels) * averageWastage;
     atlasWidth = estimatedWidth;
+    if (settings.maxTextureSize > 0)
+    {
+        atlasWidth = std::min(atlasWidth, settings.maxTextureSize);
+    }
     atlasHeight = 0;
     std::cout << "FontAtlas::estimateBounds() -> Buest guess width: " << atlasWidth << std::endl;
     std::cout << "FontAtlas::estimateBounds() -> based on average glyph aspect ratio: "
@@ -130,76 +536,252 @@ void FontAtlas::estimateBounds()
 
 void FontAtlas::optimiseForWastage()
 {
-    float bestWastage = 1.;
-    int atlasWidthToUse = 0;
+    if (settings.packer != "shelf")
+    {
+        std::cout << "FontAtlas::optimiseForWastage() -> Width search only applies to the shelf packer, skipping."
+                  << std::endl;
+        calculateLayout();
+        return;
+    }
 
-    calculateLayout();
-    int previousLastGlyhX = lastGlyphX;
-    while (true)
-    { // this is horribly inefficient
-        atlasWidth--;
+    // The shelf layout produced at a width W is unchanged for every width down to its widest row,
+    // and within that range wastage is lowest at the widest row itself. So only those breakpoints
+    // are evaluated: lay out, shrink to the widest row, then continue one pixel below it.
+    // Widths below sqrt(totalGlyphPixels) are not considered, they only produce tall thin atlases.
+    int widestGlyph = 0;
+    for (auto &i : atlasEntries)
+    {
+        widestGlyph = std::max(widestGlyph, cellSize(i.w));
+    }
+    int minWidth = std::max({1, widestGlyph, (int)std::ceil(std::sqrt((float)totalCellPixels))});
+    if (settings.maxTextureSize > 0)
+    {
+        // with pages the atlas is at most maxTextureSize wide, however many glyphs there are
+        minWidth = std::max({1, widestGlyph, std::min(minWidth, settings.maxTextureSize)});
+    }
+
+    float bestWastage = 1.;
+    int atlasWidthToUse = std::max(atlasWidth, minWidth);
+    int candidateWidth = atlasWidthToUse;
+    int layoutsEvaluated = 0;
+    while (candidateWidth >= minWidth)
+    {
+        atlasWidth = candidateWidth;
         calculateLayout();
-        if (wasteage < bestWastage)
+        layoutsEvaluated++;
+
+        int widestRow = 0;
+        for (auto &i : atlasEntries)
         {
-            bestWastage = wasteage;
-            atlasWidthToUse = atlasWidth;
+            widestRow = std::max(widestRow, i.isEmpty() ? i.ex : i.sx - glyphPadding + cellSize(i.w));
         }
-        if (lastGlyphX < previousLastGlyhX)
+        float rowWastage = (1.f - ((float)totalGlyphPixels / ((float)widestRow * atlasHeight * pageCount)));
+        if (rowWastage < bestWastage)
         {
-            break;
+            bestWastage = rowWastage;
+            atlasWidthToUse = widestRow;
         }
-        previousLastGlyhX = lastGlyphX;
+        candidateWidth = widestRow - 1;
     }
     atlasWidth = atlasWidthToUse;
     calculateLayout();
 
     std::cout << "FontAtlas::optimiseForWastage() -> Calculated Layout for "
               << atlasEntries.size() << " glyphs. (" << atlasWidth << ", " << atlasHeight << "). Best wastage: "
-              << wasteage * 100.f << std::endl;
+              << wasteage * 100.f << " after evaluating " << layoutsEvaluated << " layouts." << std::endl;
 }
 
 void FontAtlas::calculateLayout()
 {
-    int atlasCursorX = 0;
-    int atlasCursorY = 0;
-    int atlasRowTallestChar = 0;
+    auto packer = AtlasPacker::create(settings.packer);
+    if (!packer)
+    {
+        std::cout << "Unknown packer '" << settings.packer << "' defaulting to shelf" << std::endl;
+        settings.packer = "shelf";
+        packer = AtlasPacker::create(settings.packer);
+    }
+
+    std::vector<FontAtlasEntry *> entries = packingOrder();
+
+    // every glyph is packed as its cell, see calculateGutters, and then moved inside it by the
+    // padding. Cells start on multiples of the alignment, so no two glyphs share an aligned block
+    std::vector<std::pair<int, int>> glyphSizes;
+    for (auto i : entries)
+    {
+        glyphSizes.push_back({i->w, i->h});
+        i->w = cellSize(i->w);
+        i->h = cellSize(i->h);
+    }
+
+    int maxHeight = settings.maxTextureSize > 0 ? settings.maxTextureSize : INT_MAX;
+    bool oversized = false;
+    for (auto i : entries)
+    {
+        // no packer can place a glyph wider or taller than a page
+        oversized |= settings.maxTextureSize > 0 && (i->w > settings.maxTextureSize || i->h > settings.maxTextureSize);
+        atlasWidth = std::max(atlasWidth, i->w);
+        maxHeight = std::max(maxHeight, i->h);
+    }
+    if (oversized)
+    {
+        std::cout << "FontAtlas::calculateLayout() -> Some glyphs are larger than the max texture size "
+                  << settings.maxTextureSize << ", pages will be larger." << std::endl;
+    }
+
+    atlasHeight = packer->pack(entries, atlasWidth, maxHeight);
+    for (size_t e = 0; e < entries.size(); ++e)
+    {
+        auto i = entries[e];
+        i->sx += glyphPadding;
+        i->sy += glyphPadding;
+        i->w = glyphSizes[e].first;
+        i->h = glyphSizes[e].second;
+        i->ex = i->sx + i->w;
+        i->ey = i->sy + i->h;
+    }
+    resolveDuplicates();
+    pageCount = 1;
+    for (auto i : entries)
+    {
+        pageCount = std::max(pageCount, i->page + 1);
+    }
+    wasteage = (1.f - ((float)totalGlyphPixels / ((float)atlasWidth * atlasHeight * pageCount)));
+}
 
+void FontAtlas::calculateGutters()
+{
+    // Mip level k averages squares of 2^k x 2^k pixels. Cells aligned to the squares of the last
+    // level never share one, and a gutter as wide as that square keeps the bilinear taps at a
+    // glyph's edge inside its own cell on every level. Levels where even the largest glyph is
+    // under 4 texels are not guarded, glyphs are unreadable there and the gutters would only
+    // waste space.
+    int widest = 4;
+    int tallest = 4;
     for (auto &i : atlasEntries)
     {
-        int glyphWidth = i.w;
-        int glyphHeight = i.h;
+        widest = std::max(widest, i.w);
+        tallest = std::max(tallest, i.h);
+    }
+    int levels = MipChain::fullChainLength(widest / 4, tallest / 4);
+    if (settings.mipLevels > 0)
+    {
+        levels = std::min(levels, settings.mipLevels);
+    }
+    int mipAlignment = 1 << (levels - 1);
+
+    // a BC4 block must not hold pixels of two glyphs, or one glyph's range bleeds into the other.
+    // On level k a block covers 4 * 2^k base pixels, so the block grid of every guarded level
+    // needs cells aligned to 4 times the mip alignment.
+    cellAlignment = mipAlignment * (settings.textureCompression == "bc4" ? 4 : 1);
+    glyphPadding = settings.padding >= 0 ? settings.padding : mipAlignment > 1 ? mipAlignment : 0;
 
-        if ((atlasCursorX + glyphWidth) > atlasWidth)
+    totalCellPixels = 0;
+    for (auto &i : atlasEntries)
+    {
+        if (i.duplicateOf < 0 && !i.isEmpty())
         {
-            atlasCursorX = 0;
-            atlasCursorY += atlasRowTallestChar;
-            atlasRowTallestChar = 0;
+            totalCellPixels += cellSize(i.w) * cellSize(i.h);
         }
+    }
+    if (glyphPadding > 0 || cellAlignment > 1)
+    {
+        std::cout << "FontAtlas::calculateGutters() -> " << glyphPadding << " pixel padding, cells aligned to "
+                  << cellAlignment << " pixels." << std::endl;
+    }
+}
+
+int FontAtlas::alignUp(int value)
+{
+    return (value + cellAlignment - 1) / cellAlignment * cellAlignment;
+}
 
-        if (glyphHeight > atlasRowTallestChar)
+int FontAtlas::cellSize(int glyphSize)
+{
+    return alignUp(glyphSize + 2 * glyphPadding);
+}
+
+std::vector<FontAtlasEntry *> FontAtlas::packingOrder()
+{
+    // atlasEntries stays in codepoint order for the manifest, only the packers see this ordering.
+    // Duplicates are left out, resolveDuplicates gives them their rectangle afterwards, and so are
+    // empty glyphs, which need none.
+    std::vector<FontAtlasEntry *> entries;
+    entries.reserve(atlasEntries.size());
+    for (auto &i : atlasEntries)
+    {
+        if (i.duplicateOf < 0 && !i.isEmpty())
         {
-            atlasRowTallestChar = glyphHeight;
-            atlasHeight = atlasCursorY + atlasRowTallestChar;
+            entries.push_back(&i);
         }
+    }
 
-        i.sx = atlasCursorX;
-        i.sy = atlasCursorY;
-        i.ex = atlasCursorX + glyphWidth;
-        i.ey = atlasCursorY + glyphHeight;
-        atlasCursorX += glyphWidth;
-        lastGlyphX = atlasCursorX;
+    std::function<int(const FontAtlasEntry *)> key;
+    if (settings.packOrder == "height")
+    {
+        key = [](const FontAtlasEntry *e) { return e->h; };
+    }
+    else if (settings.packOrder == "area")
+    {
+        key = [](const FontAtlasEntry *e) { return e->w * e->h; };
+    }
+    else if (settings.packOrder == "perimeter")
+    {
+        key = [](const FontAtlasEntry *e) { return 2 * (e->w + e->h); };
+    }
+    else if (settings.packOrder != "none")
+    {
+        std::cout << "Unknown pack order '" << settings.packOrder << "' defaulting to none" << std::endl;
+        settings.packOrder = "none";
     }
 
-    wasteage = (1.f - ((float)totalGlyphPixels / (float)(atlasWidth * atlasHeight)));
+    if (key)
+    {
+        // largest first, ties stay in codepoint order so layouts are deterministic
+        std::stable_sort(entries.begin(), entries.end(), [&](const FontAtlasEntry *a, const FontAtlasEntry *b) {
+            return key(a) > key(b);
+        });
+    }
+    return entries;
 }
 
 void FontAtlas::allocateRasterData()
 {
+    // pages are stored one after another, all atlasWidth x atlasHeight
     setAtlasHeight();
-    atlasData = new unsigned char[atlasWidth * atlasHeight];
-    memset(atlasData, 0, atlasWidth * atlasHeight);
+    atlasWidth = alignUp(atlasWidth);
+    atlasHeight = alignUp(atlasHeight);
+    size_t bytes = (size_t)atlasWidth * atlasHeight * pageCount;
+    atlasData = new unsigned char[bytes];
+    memset(atlasData, 0, bytes);
+    stats["bytes"]["raster"] = bytes;
+
+    std::cout << "FontAtlas::allocateRasterData() -> Allocated " << bytes << " bytes for " << pageCount << " page(s)."
+              << std::endl;
+}
+
+unsigned char *FontAtlas::pageData(int page)
+{
+    return atlasData + (size_t)page * atlasWidth * atlasHeight;
+}
+
+int FontAtlas::imageCount()
+{
+    // with channel packing every image holds four pages, one per channel
+    return settings.channelPack ? (pageCount + 3) / 4 : pageCount;
+}
 
-    std::cout << "FontAtlas::allocateRasterData() -> Allocated " << atlasWidth * atlasHeight << " bytes." << std::endl;
+std::string FontAtlas::imageName(int image, int level)
+{
+    std::string name = outname;
+    if (imageCount() > 1)
+    {
+        name += "_" + std::to_string(image);
+    }
+    if (level > 0)
+    {
+        name += "_mip" + std::to_string(level);
+    }
+    return name + imageExtension(settings.imageFormat);
 }
 
 void FontAtlas::freeRasterData()
@@ -210,32 +792,97 @@ void FontAtlas::freeRasterData()
 
 void FontAtlas::rasterizeLayout()
 {
-    for (auto &i : atlasEntries)
-    {
-        for (int y = 0; y < i.h; ++y)
+    // packed rectangles are disjoint, so glyphs can be blitted from several threads at once
+    parallelFor(atlasEntries.size(), shardCount(atlasEntries.size()), [&](int shard, size_t begin, size_t end) {
+        for (size_t e = begin; e < end; ++e)
         {
-            for (int x = 0; x < i.w; ++x)
+            auto &i = atlasEntries[e];
+            if (i.duplicateOf >= 0 || i.isEmpty())
             {
-                int localAtlasX = i.sx + x;
-                int localAtlasY = i.sy + y;
-                atlasData[localAtlasY * atlasWidth + localAtlasX] = i.data[y * i.w + x];
+                continue;
+            }
+            unsigned char *dst = pageData(i.page) + i.sy * atlasWidth + i.sx;
+            for (int y = 0; y < i.h; ++y)
+            {
+                memcpy(dst + y * atlasWidth, i.data + y * i.w, i.w);
             }
+            i.data = nullptr;
         }
-        delete[] i.data;
-    }
+    });
+    glyphArena.release();
 
     std::cout << "FontAtlas::rasterizeLayout() -> Rasterized layout. Written " << totalGlyphPixels << " pixels. "
               << std::endl;
 }
 
+void FontAtlas::rasterizeDirect()
+{
+    // single pass mode: entries were only measured, render each glyph again and copy it from the
+    // glyph slot straight into its packed rectangle. Rectangles are disjoint so shards can write
+    // into atlasData concurrently.
+    int shards = shardCount(atlasEntries.size());
+    std::vector<int> mismatches(shards, 0);
+    bool edt = type == 0 && settings.sdfEngine == "edt";
+    int32_t renderTarget = type == 0 && !edt ? FT_LOAD_TARGET_(FT_RENDER_MODE_SDF) : 0;
+
+    runShards(atlasEntries.size(), shards, [&](int shard, FT_Face shardFace, size_t begin, size_t end) {
+        for (size_t e = begin; e < end; ++e)
+        {
+            auto &i = atlasEntries[e];
+            if (i.isEmpty() || i.duplicateOf >= 0)
+            {
+                continue;
+            }
+            if (FT_Load_Char(shardFace, i.code, edt ? FT_LOAD_NO_BITMAP : FT_LOAD_RENDER | renderTarget))
+            {
+                std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
+                ftErrors++;
+                continue;
+            }
+            if (edt)
+            {
+                // the placement only depends on the outline, so it is the one measured
+                renderEdt(shardFace->glyph, i.w, i.h, i.bearingX, i.bearingY, pageData(i.page) + i.sy * atlasWidth + i.sx,
+                          atlasWidth);
+                continue;
+            }
+
+            const FT_Bitmap &bitmap = shardFace->glyph->bitmap;
+            if ((int)bitmap.width != i.w || (int)bitmap.rows != i.h)
+            {
+                mismatches[shard]++;
+            }
+
+            copyBitmapRows(bitmap, pageData(i.page) + i.sy * atlasWidth + i.sx, atlasWidth, std::min(i.w, (int)bitmap.width),
+                           std::min(i.h, (int)bitmap.rows));
+        }
+    });
+
+    int totalMismatches = 0;
+    for (int m : mismatches)
+    {
+        totalMismatches += m;
+    }
+    if (totalMismatches)
+    {
+        std::cout << "FontAtlas::rasterizeDirect() -> " << totalMismatches
+                  << " glyphs rendered at a different size than measured and were clipped." << std::endl;
+    }
+
+    std::cout << "FontAtlas::rasterizeDirect() -> Rasterized layout. Written " << totalGlyphPixels << " pixels. "
+              << std::endl;
+}
+
 void FontAtlas::setAtlasHeight()
 {
     int maxY = 0;
     for (auto &a : atlasEntries)
     {
-        if (a.ey >= maxY)
+        // the bottom of the glyph's cell, so the gutter below the last row is kept
+        int bottom = a.isEmpty() ? a.ey : a.sy - glyphPadding + cellSize(a.h);
+        if (bottom >= maxY)
         {
-            maxY = a.ey;
+            maxY = bottom;
         }
     }
     atlasHeight = maxY;
@@ -243,134 +890,623 @@ void FontAtlas::setAtlasHeight()
 
 void FontAtlas::optimiseLayout()
 {
-    int finished = 0;
-    int maxY = 0;
-    while (!finished)
+    // Gravity compaction: glyphs fall towards y = 0 in the order they sit in the layout and come
+    // to rest on the highest column they span. columnHeight[x] is the first free row of column x,
+    // so each glyph needs a single range query instead of moving one pixel per pass. Every page
+    // is compacted on its own.
+    std::vector<FontAtlasEntry *> order;
+    order.reserve(atlasEntries.size());
+    int maxX = 0;
+    for (auto &a : atlasEntries)
     {
-        int collisionCount = 0;
-        for (auto &a : atlasEntries)
+        if (a.duplicateOf < 0 && !a.isEmpty())
         {
-            if (a.sy == 0)
-            { // entries on bottom row cannot move
-                collisionCount++;
-                continue;
-            }
-            bool collided = false;
-            for (auto &b : atlasEntries)
-            {
-                if (a.code == b.code)
-                    continue;
+            order.push_back(&a);
+            maxX = std::max(maxX, a.sx - glyphPadding + cellSize(a.w));
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [](const FontAtlasEntry *a, const FontAtlasEntry *b) {
+        return a->page != b->page ? a->page < b->page : a->sy < b->sy;
+    });
 
-                if (b.pointIsInside(a.sx, a.sy - 1) || b.pointIsInside(a.ex, a.sy - 1))
-                {
-                    collided = true;
-                    collisionCount++;
-                    break;
-                }
-            }
-            if (!collided)
-            {
-                a.sy -= 1;
-                a.ey -= 1;
-            }
-            if (a.ey >= maxY)
-            {
-                maxY = a.ey;
-            }
+    std::vector<int> columnHeight(maxX, 0);
+    int maxY = 0;
+    int page = 0;
+    for (auto a : order)
+    {
+        if (a->page != page)
+        {
+            page = a->page;
+            std::fill(columnHeight.begin(), columnHeight.end(), 0);
         }
 
-        if (collisionCount >= atlasEntries.size())
+        // columns and heights are those of the glyph's cell, see calculateLayout
+        int cellX = a->sx - glyphPadding;
+        int cellEnd = cellX + cellSize(a->w);
+        int restY = 0;
+        for (int x = cellX; x < cellEnd; ++x)
         {
-            finished = true;
+            restY = std::max(restY, columnHeight[x]);
         }
+
+        a->ey = restY + glyphPadding + (a->ey - a->sy);
+        a->sy = restY + glyphPadding;
+        std::fill(columnHeight.begin() + cellX, columnHeight.begin() + cellEnd, restY + cellSize(a->h));
+        maxY = std::max(maxY, restY + cellSize(a->h));
     }
+    resolveDuplicates();
     atlasHeight = maxY;
+    wasteage = (1.f - ((float)totalGlyphPixels / ((float)atlasWidth * atlasHeight * pageCount)));
+
+    std::cout << "FontAtlas::optimiseLayout() -> Compacted layout to (" << atlasWidth << ", " << atlasHeight
+              << ") x " << pageCount << " page(s). Wastage: " << wasteage * 100.f << std::endl;
+}
+
+int FontAtlas::mipLevelCount()
+{
+    int levels = MipChain::fullChainLength(atlasWidth, atlasHeight);
+    return settings.mipLevels > 0 ? std::min(settings.mipLevels, levels) : levels;
 }
 
-void FontAtlas::writeManifest()
+bool FontAtlas::writeManifest()
 {
     manifest["width"] = atlasWidth;
     manifest["height"] = atlasHeight;
-    manifest["atlas"] = outname + ".png";
+    manifest["atlas"] = imageName(0);
     manifest["font"] = path.filename();
     manifest["face"] = face->family_name;
     manifest["size"] = size;
     manifest["type"] = typeString;
+    if (type == 0)
+    {
+        manifest["sdf_engine"] = settings.sdfEngine;
+        manifest["spread"] = sdfSpread;
+        if (settings.sdfEngine == "edt")
+        {
+            manifest["oversample"] = settings.oversample;
+        }
+    }
     manifest["retina"] = retina;
     manifest["retina_scale"] = (int)retina * 2;
-
-    for (auto &i : atlasEntries)
+    bool paged = settings.maxTextureSize > 0 || settings.channelPack;
+    if (paged)
+    {
+        manifest["pages"] = nlohmann::json::array();
+        for (int p = 0; p < imageCount(); ++p)
+        {
+            manifest["pages"].push_back(imageName(p));
+        }
+    }
+    if (settings.channelPack)
+    {
+        manifest["channels"] = 4;
+    }
+    if (settings.textureCompression != "none")
+    {
+        manifest["compression"] = settings.textureCompression;
+    }
+    if (glyphPadding > 0)
+    {
+        manifest["padding"] = glyphPadding;
+    }
+    if (settings.mipLevels != 1)
+    {
+        manifest["mip_levels"] = mipLevelCount();
+    }
+    if (!atlasEntries.empty())
     {
-        nlohmann::json ch;
-        ch["sx"] = i.sx;
-        ch["sy"] = i.sy;
-        ch["ex"] = i.ex;
-        ch["ey"] = i.ey;
-        ch["c"] = i.code;
-        ch["i"] = i.index;
-        ch["bx"] = i.bearingX;
-        ch["by"] = i.bearingY;
-        ch["a"] = i.advance;
-        manifest["characters"].push_back(ch);
+        manifest["characters"] = nullptr; // placeholder, streamed below
     }
-    std::string jsonOutName = outname + ".json";
+
+    std::string jsonOutName = outputFile(".json");
 
     std::ofstream manifestFile(jsonOutName, std::ios::out | std::ios::binary);
-    if (manifestFile)
+    if (!manifestFile)
     {
-        std::string output = manifest.dump();
-        manifestFile.write(output.c_str(), output.size());
+        std::cout << "Unable to open " << jsonOutName << " for writing" << std::endl;
+        return false;
     }
-    else
+
+    // The characters are streamed instead of being built as one json object per glyph. Keys are
+    // written in the sorted order nlohmann::json uses, so the file matches manifest.dump() of the
+    // complete tree byte for byte.
     {
-        std::cout << "Unable to open " << jsonOutName << " for writing" << std::endl;
-        return;
+        JsonStreamWriter writer(manifestFile);
+        writer.raw('{');
+        bool firstKey = true;
+        for (auto &item : manifest.items())
+        {
+            if (!firstKey)
+            {
+                writer.raw(',');
+            }
+            firstKey = false;
+            writer.key(item.key());
+
+            if (item.key() != "characters")
+            {
+                writer.value(item.value());
+                continue;
+            }
+
+            writer.raw('[');
+            for (size_t e = 0; e < atlasEntries.size(); ++e)
+            {
+                auto &i = atlasEntries[e];
+                writer.raw(e == 0 ? "{\"a\":" : ",{\"a\":");
+                writer.integer(i.advance);
+                writer.raw(",\"bx\":");
+                writer.integer(i.bearingX);
+                writer.raw(",\"by\":");
+                writer.integer(i.bearingY);
+                writer.raw(",\"c\":");
+                writer.integer(i.code);
+                if (settings.channelPack)
+                {
+                    writer.raw(",\"ch\":");
+                    writer.integer(i.page % 4);
+                }
+                writer.raw(",\"ex\":");
+                writer.integer(i.ex);
+                writer.raw(",\"ey\":");
+                writer.integer(i.ey);
+                writer.raw(",\"i\":");
+                writer.integer(i.index);
+                if (paged)
+                {
+                    writer.raw(",\"p\":");
+                    writer.integer(settings.channelPack ? i.page / 4 : i.page);
+                }
+                writer.raw(",\"sx\":");
+                writer.integer(i.sx);
+                writer.raw(",\"sy\":");
+                writer.integer(i.sy);
+                writer.raw('}');
+            }
+            writer.raw(']');
+        }
+        writer.raw('}');
     }
+    manifest.erase("characters");
 
     manifestFile.close();
+    if (manifestFile.fail())
+    {
+        std::cout << "Unable to write " << jsonOutName << std::endl;
+        return false;
+    }
     std::cout << "FontAtlas::writeManifest() -> "
               << " written " << jsonOutName << std::endl;
+    return true;
+}
+
+bool FontAtlas::writeBinaryManifest()
+{
+    // see FontAtlasBinary.h for the layout
+    std::string strings;
+    auto addString = [&](const std::string &s) {
+        uint32_t offset = strings.size();
+        strings += s;
+        strings += '\0';
+        return offset;
+    };
+    uint32_t atlasName = addString(imageName(0));
+    for (int p = 1; p < imageCount(); ++p)
+    {
+        addString(imageName(p));
+    }
+    uint32_t fontName = addString(path.filename().string());
+    uint32_t faceName = addString(face->family_name ? face->family_name : "");
+
+    uint32_t glyphOffset = sizeof(FontAtlasBinaryHeader);
+    uint32_t stringsOffset = glyphOffset + atlasEntries.size() * sizeof(FontAtlasBinaryGlyph);
+
+    std::vector<unsigned char> out;
+    out.reserve(stringsOffset + strings.size());
+    out.insert(out.end(), fontAtlasBinaryMagic, fontAtlasBinaryMagic + 4);
+    putU32(out, fontAtlasBinaryVersion);
+    putU32(out, sizeof(FontAtlasBinaryHeader));
+    putU32(out, atlasEntries.size());
+    putU32(out, glyphOffset);
+    putU32(out, stringsOffset);
+    putU32(out, atlasWidth);
+    putU32(out, atlasHeight);
+    putU32(out, size);
+    putU32(out, type);
+    putU32(out, (int)retina * 2);
+    putU32(out, imageCount());
+    putU32(out, settings.channelPack ? 4 : 1);
+    putU32(out, atlasName);
+    putU32(out, fontName);
+    putU32(out, faceName);
+    putU32(out, settings.textureCompression == "bc4" ? 1 : 0);
+    putU32(out, mipLevelCount());
+    putU32(out, glyphPadding);
+    putU32(out, type == 0 && settings.sdfEngine == "edt" ? 1 : 0);
+    putU32(out, type == 0 ? sdfSpread : 0);
+    putU32(out, type == 0 && settings.sdfEngine == "edt" ? settings.oversample : 0);
+
+    if (atlasWidth > 0xffff || atlasHeight > 0xffff)
+    {
+        std::cout << "FontAtlas::writeBinaryManifest() -> Atlas is larger than 65535 pixels, coordinates will be truncated"
+                  << std::endl;
+    }
+
+    // atlasEntries are already in codepoint order
+    for (auto &i : atlasEntries)
+    {
+        putU32(out, i.code);
+        putU32(out, i.index);
+        putU16(out, i.sx);
+        putU16(out, i.sy);
+        putU16(out, i.ex);
+        putU16(out, i.ey);
+        putU16(out, (int16_t)i.bearingX);
+        putU16(out, (int16_t)i.bearingY);
+        putU32(out, i.advance);
+        putU16(out, settings.channelPack ? i.page / 4 : i.page);
+        putU16(out, settings.channelPack ? i.page % 4 : 0);
+    }
+    out.insert(out.end(), strings.begin(), strings.end());
+
+    std::string binOutName = outputFile(".bin");
+    std::ofstream manifestFile(binOutName, std::ios::out | std::ios::binary);
+    if (!manifestFile)
+    {
+        std::cout << "Unable to open " << binOutName << " for writing" << std::endl;
+        return false;
+    }
+    manifestFile.write((const char *)out.data(), out.size());
+    manifestFile.close();
+    if (manifestFile.fail())
+    {
+        std::cout << "Unable to write " << binOutName << std::endl;
+        return false;
+    }
+    std::cout << "FontAtlas::writeBinaryManifest() -> "
+              << " written " << binOutName << std::endl;
+    return true;
+}
+
+bool FontAtlas::writeImages()
+{
+    bool allWritten = true;
+    PngOptions png = settings.png;
+    png.threads = settings.threads;
+    std::vector<unsigned char> rgba;
+    for (int p = 0; p < imageCount(); ++p)
+    {
+        std::string imageOutName = outputFile(imageName(p).substr(outname.size()));
+        const unsigned char *pixels = pageData(p);
+        int channels = 1;
+        if (settings.channelPack)
+        {
+            std::vector<const unsigned char *> planes;
+            for (int c = 0; c < 4 && p * 4 + c < pageCount; ++c)
+            {
+                planes.push_back(pageData(p * 4 + c));
+            }
+            rgba.resize((size_t)atlasWidth * atlasHeight * 4);
+            interleaveChannels(planes, atlasWidth, atlasHeight, rgba.data());
+            pixels = rgba.data();
+            channels = 4;
+        }
+
+        bool written;
+        MipChain chain(pixels, atlasWidth, atlasHeight, channels, settings.mipLevels, settings.threads);
+        if (settings.imageFormat == "png")
+        {
+            // png has no mip levels, every level after the first goes to its own <image>_mip<level>.png
+            written = writePng(imageOutName, pixels, atlasWidth, atlasHeight, channels, png);
+            for (int level = 1; level < (int)chain.levels.size() && written; ++level)
+            {
+                const MipLevel &mip = chain.levels[level];
+                std::string levelOutName = outputFile(imageName(p, level).substr(outname.size()));
+                written = writePng(levelOutName, mip.data, mip.width, mip.height, channels, png);
+                if (written)
+                {
+                    std::cout << "FontAtlas::writeImages() -> "
+                              << " written " << levelOutName << std::endl;
+                }
+            }
+        }
+        else
+        {
+            TextureFormat format = channels == 4                            ? TextureFormat::RGBA8
+                                   : settings.textureCompression == "bc4" ? TextureFormat::BC4
+                                                                          : TextureFormat::R8;
+            written = writeTexture(imageOutName, settings.imageFormat, chain, format, settings.threads);
+        }
+        if (!written)
+        {
+            std::cout << "Unable to write " << imageOutName << std::endl;
+            allWritten = false;
+            continue;
+        }
+        std::cout << "FontAtlas::writeImages() -> "
+                  << " written " << imageOutName << std::endl;
+    }
+    return allWritten;
+}
+
+void FontAtlas::writeStats(double totalMs)
+{
+    stats["font"] = path.filename().string();
+    stats["size"] = size;
+    stats["type"] = typeString;
+    stats["retina"] = retina;
+    stats["totalMs"] = totalMs;
+    stats["ftErrors"] = ftErrors.load();
+    if (stats["cache"] != "hit")
+    {
+        stats["layout"] = {
+            {"width", atlasWidth},
+            {"height", atlasHeight},
+            {"pages", pageCount},
+            {"glyphPixels", totalGlyphPixels},
+            {"padding", glyphPadding},
+            {"wastage", wasteage},
+        };
+
+        size_t outputBytes = 0;
+        for (auto &file : outputFiles)
+        {
+            std::error_code error;
+            auto fileSize = std::filesystem::file_size(file, error);
+            outputBytes += error ? 0 : fileSize;
+        }
+        stats["bytes"]["outputs"] = outputBytes;
+    }
+
+    std::string statsOutName = outputFile("_stats.json");
+    std::ofstream statsFile(statsOutName);
+    if (!statsFile)
+    {
+        std::cout << "Unable to open " << statsOutName << " for writing" << std::endl;
+        return;
+    }
+    statsFile << stats.dump(4) << std::endl;
+    std::cout << "FontAtlas::writeStats() -> "
+              << " written " << statsOutName << std::endl;
+}
+
+bool FontAtlas::openFontFile()
+{
+    if (!fontFile)
+    {
+        fontFile = FontFile::open(path);
+        if (!fontFile)
+        {
+            std::cout << "FontAtlas::openFontFile Unable to map " << path << std::endl;
+        }
+    }
+    return fontFile != nullptr;
+}
+
+std::string FontAtlas::outputFile(const std::string &suffix)
+{
+    // never write through an existing file, it may be a hard link into the atlas cache
+    std::string name = outname + suffix;
+    std::error_code error;
+    std::filesystem::remove(name, error);
+    outputFiles.push_back(name);
+    return name;
 }
 
-void FontAtlas::writePNG()
+// Version of the FreeType library loaded at run time, which may differ from the headers after an
+// upgrade of the shared library.
+static std::string freetypeVersion()
 {
-    std::string pngOutName = outname + ".png";
-    stbi_write_png(pngOutName.c_str(), atlasWidth, atlasHeight, 1, atlasData, atlasWidth);
-    std::cout << "FontAtlas::writePNG() -> "
-              << " written " << pngOutName << std::endl;
+    static const std::string version = [] {
+        FT_Library library;
+        if (FT_Init_FreeType(&library))
+        {
+            return std::string("unknown");
+        }
+        FT_Int major, minor, patch;
+        FT_Library_Version(library, &major, &minor, &patch);
+        FT_Done_FreeType(library);
+        return std::to_string(major) + "." + std::to_string(minor) + "." + std::to_string(patch);
+    }();
+    return version;
+}
+
+std::string FontAtlas::cacheKey(int maxCodePoint)
+{
+    if (!openFontFile())
+    {
+        return "";
+    }
+    uint64_t fontHash = fontFile->hash();
+
+    // every input that changes the written files has to be part of the key, the rasterizer included
+    std::string inputs = "v2";
+    inputs += " freetype=" + freetypeVersion();
+    inputs += " name=" + path.filename().string();
+    inputs += " size=" + std::to_string(size);
+    inputs += " maxCodepoint=" + std::to_string(maxCodePoint);
+    inputs += " type=" + typeString;
+    inputs += " retina=" + std::to_string(retina);
+    inputs += " packer=" + settings.packer;
+    inputs += " packOrder=" + settings.packOrder;
+    inputs += " optimiseWidth=" + std::to_string(settings.optimiseWidth);
+    inputs += " manifest=" + settings.manifestFormat;
+    inputs += " maxTextureSize=" + std::to_string(settings.maxTextureSize);
+    inputs += " channelPack=" + std::to_string(settings.channelPack);
+    inputs += " dedupeBitmaps=" + std::to_string(settings.dedupeBitmaps);
+    inputs += " image=" + settings.imageFormat + "/" + std::to_string(settings.mipLevels) + "/" + settings.textureCompression;
+    inputs += " padding=" + std::to_string(settings.padding);
+    inputs += " sdf=" + settings.sdfEngine + "/" + std::to_string(settings.spread) + "/" + std::to_string(settings.oversample);
+    inputs += " png=" + settings.png.encoder + "/" + std::to_string(settings.png.level) + "/" + settings.png.filter;
+    return hashToHex(fontHash) + "_" + hashToHex(hashString(inputs));
 }
 
-FontAtlas::FontAtlas(std::filesystem::path path, int size, int maxCodePoint, bool retina, std::string type) : path(path), size(size), retina(retina), typeString(type)
+FontAtlas::FontAtlas(std::filesystem::path path, int size, int maxCodePoint, bool retina, std::string type, FontAtlasSettings settings) : settings(settings), typeString(type), retina(retina), size(size), path(path), ownsFreetype(true)
+{
+    succeeded = generate(maxCodePoint);
+}
+
+FontAtlas::FontAtlas(FT_Library ft, FT_Face face, std::shared_ptr<FontFile> fontFile, std::filesystem::path path, int size, int maxCodePoint, bool retina, std::string type, FontAtlasSettings settings) : settings(settings), typeString(type), retina(retina), size(size), path(path), ft(ft), face(face), fontFile(fontFile), ownsFreetype(false)
+{
+    succeeded = generate(maxCodePoint);
+}
+
+void FontAtlas::runStage(const char *name, const std::function<void()> &stage)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    stage();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    stats["stages"].push_back({{"name", name}, {"ms", ms}});
+    if (settings.onStage)
+    {
+        settings.onStage(name, ms);
+    }
+}
+
+std::string FontAtlas::outputName(const std::filesystem::path &path, int size, bool retina, const std::string &type)
+{
+    std::string name = path.filename().stem().string() + "_" + std::to_string(size);
+    if(retina) {
+        name += "_retina";
+    }
+    if(type == "bitmap") {
+        name += "_bitmap";
+    }
+    return name;
+}
+
+bool FontAtlas::generate(int maxCodePoint)
 {
     //TODO: move this outside of class and make enum
-    if(type == "sdf") {
-        this->type = 0;
-    } else if (type == "bitmap") {
-        this->type = 1;
+    if(typeString == "sdf") {
+        type = 0;
+    } else if (typeString == "bitmap") {
+        type = 1;
     } else {
-        this->type = 0;
-        std::cout << "Unknown type '" << type << "' defaulting to SDF" << std::endl;
+        type = 0;
+        std::cout << "Unknown type '" << typeString << "' defaulting to SDF" << std::endl;
         typeString = "sdf";
     }
-        std::cout << "generating: " << type << std::endl;
+        std::cout << "generating: " << typeString << std::endl;
+
+    if (settings.manifestFormat != "json" && settings.manifestFormat != "binary" && settings.manifestFormat != "both")
+    {
+        std::cout << "Unknown manifest format '" << settings.manifestFormat << "' defaulting to json" << std::endl;
+        settings.manifestFormat = "json";
+    }
+    if (settings.sdfEngine != "freetype" && settings.sdfEngine != "edt")
+    {
+        std::cout << "Unknown sdf engine '" << settings.sdfEngine << "' defaulting to freetype" << std::endl;
+        settings.sdfEngine = "freetype";
+    }
+    if (settings.sdfEngine == "freetype" && settings.spread > 0 && (settings.spread < 2 || settings.spread > 32))
+    {
+        std::cout << "FreeType's sdf spread is 2 to 32, clamping " << settings.spread << std::endl;
+        settings.spread = std::clamp(settings.spread, 2, 32);
+    }
+    if (settings.oversample < 1)
+    {
+        std::cout << "Oversampling must be at least 1, using 1" << std::endl;
+        settings.oversample = 1;
+    }
+    if (imageExtension(settings.imageFormat).empty())
+    {
+        std::cout << "Unknown image format '" << settings.imageFormat << "' defaulting to png" << std::endl;
+        settings.imageFormat = "png";
+    }
+    if (settings.textureCompression != "none" && settings.textureCompression != "bc4")
+    {
+        std::cout << "Unknown texture compression '" << settings.textureCompression << "' defaulting to none" << std::endl;
+        settings.textureCompression = "none";
+    }
+    if (settings.textureCompression == "bc4")
+    {
+        if (settings.imageFormat == "png")
+        {
+            std::cout << "BC4 needs a texture image format, writing dds" << std::endl;
+            settings.imageFormat = "dds";
+        }
+        if (settings.channelPack)
+        {
+            std::cout << "BC4 holds a single channel, ignoring channel packing" << std::endl;
+            settings.channelPack = false;
+        }
+    }
 
-    outname = "";
+    outname = outputName(path, size, retina, typeString);
     auto start = std::chrono::high_resolution_clock::now();
-    initFreetype();
-    loadAtlasEntries(size, maxCodePoint);
+    stats["cache"] = settings.cacheDir.empty() ? "off" : "miss";
+
+    std::string key;
+    if (!settings.cacheDir.empty())
+    {
+        key = cacheKey(maxCodePoint);
+        if (!key.empty() && AtlasCache(settings.cacheDir).restore(key))
+        {
+            std::cout << "FontAtlas::generate -> Restored " << key << " from cache in "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count()
+                      << " ms." << std::endl;
+            stats["cache"] = "hit";
+            if (settings.writeStats)
+            {
+                writeStats(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+            }
+            return true;
+        }
+    }
+
+    bool loaded = false;
+    runStage("initFreetype", [&] { loaded = initFreetype(); });
+    if (!loaded)
+    {
+        return false;
+    }
+    runStage("loadAtlasEntries", [&] { loadAtlasEntries(size, maxCodePoint); });
 
     std::cout << "FontAtlas::loadAtlasEntries() -> Populated " << atlasEntries.size() << " entries." << std::endl;
-    estimateBounds();
-    // optimiseForWastage();
-    // optimiseLayout();
-    calculateLayout();
-    allocateRasterData();
-    rasterizeLayout();
-    writeManifest();
-    writePNG();
+    runStage("estimateBounds", [&] { estimateBounds(); });
+    if (settings.optimiseWidth)
+    {
+        runStage("optimiseForWastage", [&] { optimiseForWastage(); });
+    }
+    else
+    {
+        runStage("calculateLayout", [&] { calculateLayout(); });
+    }
+    runStage("optimiseLayout", [&] { optimiseLayout(); });
+    runStage("allocateRasterData", [&] { allocateRasterData(); });
+    if (settings.directRasterize)
+    {
+        runStage("rasterizeDirect", [&] { rasterizeDirect(); });
+    }
+    else
+    {
+        runStage("rasterizeLayout", [&] { rasterizeLayout(); });
+    }
+    bool written = true;
+    if (settings.manifestFormat != "binary")
+    {
+        runStage("writeManifest", [&] { written &= writeManifest(); });
+    }
+    if (settings.manifestFormat != "json")
+    {
+        runStage("writeBinaryManifest", [&] { written &= writeBinaryManifest(); });
+    }
+    runStage("writeImages", [&] { written &= writeImages(); });
     freeFreetype();
     freeRasterData();
-    std::cout << "FontAtlas::FontAtlas -> Generated in "
+    // a partial set of files must not be served from the cache
+    if (!key.empty() && written)
+    {
+        AtlasCache(settings.cacheDir).store(key, outputFiles);
+    }
+    std::cout << "FontAtlas::generate -> Generated in "
               << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count()
               << " ms." << std::endl;
+    // written last and kept out of the atlas cache, the numbers describe this run only
+    if (settings.writeStats)
+    {
+        writeStats(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+    }
+    return written;
 }
\ No newline at end of file
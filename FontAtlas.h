@@ -8,12 +8,20 @@
 #include <vector>
 #include <iostream>
 #include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <atomic>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H  
 
 #include <nlohmann/json.hpp>
 
+#include "FontFile.h"
+#include "GlyphArena.h"
+#include "PngEncoder.h"
+
 struct FontAtlasEntry {
     int code;
     int index;
@@ -28,56 +36,159 @@ struct FontAtlasEntry {
     int bearingX;
     int bearingY;
     int advance;
-    bool pointIsInside(int x, int y);
+    int page = 0;
+    int duplicateOf = -1; // atlasEntries index of the glyph whose rectangle this one shares, -1 if packed itself
+    bool isEmpty() const;
+};
+
+struct FontAtlasSettings {
+    int threads = 0; // glyph rendering workers, 0 = one per hardware thread
+    bool optimiseWidth = false; // search for the atlas width with the least wastage
+    std::string packer = "shelf"; // shelf, maxrects or skyline, see AtlasPacker
+    std::string packOrder = "none"; // order glyphs are packed in: none (codepoint), height, area or perimeter
+    bool directRasterize = false; // measure, pack, then render glyphs straight into the atlas
+    std::string cacheDir; // reuse previously generated files from this directory, empty = no cache
+    std::string glyphCacheDir; // reuse previously rendered glyphs from this directory, empty = no cache
+    std::string manifestFormat = "json"; // json, binary (see FontAtlasBinary.h) or both
+    int maxTextureSize = 0; // largest page width and height, glyphs spill onto more pages; 0 = one page
+    bool channelPack = false; // store four pages in the R, G, B and A channels of each image
+    bool dedupeBitmaps = false; // also share one rectangle between glyphs whose rendered bitmaps are identical
+    std::string imageFormat = "png"; // png, or raw, ktx2 or dds for uncompressed textures (see TextureWriter.h)
+    int mipLevels = 1; // levels written with every image, 0 = full chain; png writes one file per level
+    int padding = -1; // empty pixels around every glyph, -1 = enough for mipLevels to filter without bleeding
+    std::string sdfEngine = "freetype"; // freetype (FT_RENDER_MODE_SDF) or edt (see SdfGenerator.h)
+    int spread = 0; // sdf distance range in pixels on each side of the outline, 0 = FreeType's default
+    int oversample = 4; // edt renders outlines this many times larger than the atlas for the distance transform
+    std::string textureCompression = "none"; // none or bc4 (see BlockCompressor.h) for raw, ktx2 and dds images
+    PngOptions png; // encoder for the atlas images, png.threads is taken from threads
+    bool writeStats = false; // write <atlas>_stats.json with stage timings, glyph counts, bytes and FreeType errors
+    std::function<void(const char *, double)> onStage; // called with the name and milliseconds of each pipeline stage
 };
 
 class FontAtlas {
     public:
 
-    void initFreetype();
+    bool openFontFile();
+
+    // Returns false, with nothing left to free, if the font could not be loaded.
+    bool initFreetype();
 
     void freeFreetype();
 
     void loadAtlasEntries(int size, int maxCodepoint);
 
+    bool renderGlyph(FT_Face face, FT_ULong code, FT_UInt index, GlyphArena &arena, FontAtlasEntry &entry);
+
+    // Sets the spread of FreeType's sdf and bsdf renderers in a library, if one was given.
+    void configureSdf(FT_Library library);
+
+    // Distance field of the outline loaded into slot with the edt engine, width x height pixels
+    // at bearingX, bearingY as measured by edtPlacement, written to dst rows dstPitch bytes apart.
+    // The outline is transformed in place.
+    bool renderEdt(FT_GlyphSlot slot, int width, int height, int bearingX, int bearingY, unsigned char *dst, int dstPitch);
+
+    int shardCount(size_t glyphs);
+
+    void runShards(size_t glyphs, int shards, const std::function<void(int, FT_Face, size_t, size_t)> &fn);
+
+    void dedupeBitmaps();
+
+    void resolveDuplicates();
+
     void estimateBounds();
 
     void optimiseForWastage();
 
     void calculateLayout();
 
+    std::vector<FontAtlasEntry *> packingOrder();
+
+    // Sets glyphPadding and cellAlignment from the settings and the glyph sizes.
+    void calculateGutters();
+
+    int alignUp(int value);
+
+    // Size of the cell a glyph of glyphSize pixels is packed in, its padding on both sides
+    // rounded up to cellAlignment.
+    int cellSize(int glyphSize);
+
     void allocateRasterData();
 
+    unsigned char *pageData(int page);
+
+    int imageCount();
+
+    std::string imageName(int image, int level = 0);
+
     void freeRasterData();
 
     void rasterizeLayout();
 
+    void rasterizeDirect();
+
     void setAtlasHeight();
 
     void optimiseLayout();
 
-    void writeManifest();
+    // Levels written with every image, settings.mipLevels clamped to the full chain.
+    int mipLevelCount();
+
+    bool writeManifest();
+
+    bool writeBinaryManifest();
+
+    bool writeImages();
+
+    void writeStats(double totalMs);
+
+    std::string outputFile(const std::string &suffix);
+
+    // Name every output file of an atlas starts with, <font stem>_<size>[_retina][_bitmap].
+    static std::string outputName(const std::filesystem::path &path, int size, bool retina, const std::string &type);
+
+    std::string cacheKey(int maxCodePoint);
+
+    // Runs one step of generate and reports its duration to settings.onStage.
+    void runStage(const char *name, const std::function<void()> &stage);
+
+    // Returns false if the font could not be loaded or an output file could not be written.
+    bool generate(int maxCodePoint);
 
-    void writePNG();
+    FontAtlas(std::filesystem::path path, int size, int maxCodePoint, bool retina, std::string type, FontAtlasSettings settings = {});
 
-    FontAtlas(std::filesystem::path path, int size, int maxCodePoint, bool retina, std::string type);
+    // Generates from an already loaded face, which is left open. The face must not be used by
+    // anything else until the constructor returns. fontFile is the mapping the face was opened
+    // from, render threads open their own faces over it.
+    FontAtlas(FT_Library ft, FT_Face face, std::shared_ptr<FontFile> fontFile, std::filesystem::path path, int size, int maxCodePoint, bool retina, std::string type, FontAtlasSettings settings = {});
     
+    FontAtlasSettings settings;
     std::string typeString;
     int type;
     bool retina;
     int atlasWidth;
     int atlasHeight;
+    int pageCount;
     int size;
     std::filesystem::path path;
     FT_Library ft;
     FT_Face face;
+    std::shared_ptr<FontFile> fontFile;
+    bool ownsFreetype;
+    FT_Int sdfSpread;
     unsigned char* atlasData;
     nlohmann::json manifest;
     std::string outname;
+    std::vector<std::string> outputFiles;
     std::vector<FontAtlasEntry> atlasEntries;
+    GlyphArena glyphArena; // owns every FontAtlasEntry::data until rasterizeLayout
     int totalGlyphPixels;
-    int lastGlyphX;
+    int totalCellPixels; // area of the glyph cells, totalGlyphPixels plus gutters and alignment
+    int glyphPadding = 0; // empty pixels on each side of a glyph inside its cell
+    int cellAlignment = 1; // cells start on multiples of this and their sizes are rounded up to it
     float wasteage;
     float averageGlpyhWidth;
     float averageGlpyhHeight;
+    nlohmann::json stats; // filled in by the stages, see writeStats
+    std::atomic<int> ftErrors = 0;
+    bool succeeded = false; // result of generate
 };
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+
+// Layout of the binary manifest written with -manifest binary. All fields are little endian and
+// every struct is naturally aligned, so on little endian targets a client can map the file and
+// use it in place:
+//
+//   FontAtlasBinaryHeader
+//   FontAtlasBinaryGlyph[glyphCount]   at glyphOffset, sorted by codepoint
+//   NUL terminated strings             at stringsOffset, referenced by the *Name fields
+
+static const char fontAtlasBinaryMagic[4] = {'F', 'A', 'T', 'M'};
+static const uint32_t fontAtlasBinaryVersion = 4;
+
+struct FontAtlasBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t glyphCount;
+    uint32_t glyphOffset;
+    uint32_t stringsOffset;
+    uint32_t width;
+    uint32_t height;
+    uint32_t size;
+    uint32_t type;        // 0 = sdf, 1 = bitmap
+    uint32_t retinaScale; // 0 or 2
+    uint32_t pageCount;   // number of images
+    uint32_t channels;    // 1, or 4 when pages are packed into the RGBA channels of each image
+    uint32_t atlasName;   // offsets relative to stringsOffset, pageCount image names follow one another
+    uint32_t fontName;
+    uint32_t faceName;
+    uint32_t compression; // 0 = none, 1 = bc4 blocks
+    uint32_t mipLevels;   // levels in each image, 1 without -mipLevels
+    uint32_t padding;     // empty pixels around every glyph, not part of the glyph rectangles
+    uint32_t sdfEngine;   // 0 = freetype, 1 = edt; sdf atlases only
+    uint32_t spread;      // sdf distance range in pixels on each side of the outline, 0 for bitmap atlases
+    uint32_t oversample;  // edt outline oversampling, 0 otherwise
+};
+
+struct FontAtlasBinaryGlyph {
+    uint32_t codepoint;
+    uint32_t index;
+    uint16_t sx;
+    uint16_t sy;
+    uint16_t ex;
+    uint16_t ey;
+    int16_t bearingX;
+    int16_t bearingY;
+    int32_t advance;
+    uint16_t page;        // image index
+    uint16_t channel;
+};
+
+static_assert(sizeof(FontAtlasBinaryHeader) == 88, "binary manifest header must be packed");
+static_assert(sizeof(FontAtlasBinaryGlyph) == 28, "binary manifest glyph must be packed");
+
+// Binary searches a mapped manifest for a codepoint, nullptr if the atlas does not contain it.
+inline const FontAtlasBinaryGlyph *fontAtlasBinaryFind(const void *manifest, uint32_t codepoint)
+{
+    const FontAtlasBinaryHeader *header = (const FontAtlasBinaryHeader *)manifest;
+    const FontAtlasBinaryGlyph *glyphs = (const FontAtlasBinaryGlyph *)((const char *)manifest + header->glyphOffset);
+    uint32_t lo = 0;
+    uint32_t hi = header->glyphCount;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (glyphs[mid].codepoint < codepoint)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo < header->glyphCount && glyphs[lo].codepoint == codepoint ? &glyphs[lo] : nullptr;
+}
@@ -0,0 +1,82 @@
+#include "FontFile.h"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Hash.h"
+
+std::shared_ptr<FontFile> FontFile::open(const std::filesystem::path &path)
+{
+    std::shared_ptr<FontFile> file(new FontFile());
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    file->mapped = (const unsigned char *)mapping;
+    file->mappedSize = info.st_size;
+#else
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in)
+    {
+        return nullptr;
+    }
+    file->contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if (file->contents.empty())
+    {
+        return nullptr;
+    }
+    file->mapped = file->contents.data();
+    file->mappedSize = file->contents.size();
+#endif
+
+    return file;
+}
+
+FontFile::~FontFile()
+{
+#ifndef _WIN32
+    if (mapped)
+    {
+        munmap((void *)mapped, mappedSize);
+    }
+#endif
+}
+
+const unsigned char *FontFile::data() const
+{
+    return mapped;
+}
+
+size_t FontFile::size() const
+{
+    return mappedSize;
+}
+
+uint64_t FontFile::hash()
+{
+    std::call_once(hashOnce, [this]() { contentHash = hashBytes(mapped, mappedSize); });
+    return contentHash;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A font file mapped read-only into memory. Every FT_Face opened with FT_New_Memory_Face over
+// data() shares the one mapping, which has to outlive all of them.
+class FontFile {
+    public:
+
+    // Returns nullptr if the file cannot be opened or is empty.
+    static std::shared_ptr<FontFile> open(const std::filesystem::path &path);
+
+    FontFile(const FontFile &) = delete;
+    FontFile &operator=(const FontFile &) = delete;
+    ~FontFile();
+
+    const unsigned char *data() const;
+
+    size_t size() const;
+
+    // FNV-1a of the contents, computed on first use.
+    uint64_t hash();
+
+    private:
+
+    FontFile() = default;
+
+    const unsigned char *mapped = nullptr;
+    size_t mappedSize = 0;
+    std::vector<unsigned char> contents; // used where mmap is unavailable
+    std::once_flag hashOnce;
+    uint64_t contentHash = 0;
+};
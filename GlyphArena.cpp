@@ -0,0 +1,63 @@
+#include "GlyphArena.h"
+
+#include <algorithm>
+#include <iterator>
+
+GlyphArena::GlyphArena(size_t blockSize) : blockSize(blockSize), blockUsed(0), blockCapacity(0), totalAllocated(0)
+{
+}
+
+unsigned char *GlyphArena::allocate(size_t bytes)
+{
+    if (bytes == 0)
+    {
+        return nullptr;
+    }
+
+    if (blocks.empty() || blockUsed + bytes > blockCapacity)
+    {
+        blockCapacity = std::max(blockSize, bytes);
+        blocks.emplace_back(new unsigned char[blockCapacity]);
+        blockUsed = 0;
+    }
+
+    unsigned char *data = blocks.back().get() + blockUsed;
+    blockUsed += bytes;
+    totalAllocated += bytes;
+    return data;
+}
+
+void GlyphArena::adopt(GlyphArena &other)
+{
+    if (blocks.empty())
+    {
+        blocks = std::move(other.blocks);
+        blockUsed = other.blockUsed;
+        blockCapacity = other.blockCapacity;
+    }
+    else
+    {
+        // keep our current block last so allocation carries on where it left off
+        blocks.insert(blocks.end() - 1, std::make_move_iterator(other.blocks.begin()),
+                      std::make_move_iterator(other.blocks.end()));
+    }
+    totalAllocated += other.totalAllocated;
+
+    other.blocks.clear();
+    other.blockUsed = 0;
+    other.blockCapacity = 0;
+    other.totalAllocated = 0;
+}
+
+void GlyphArena::release()
+{
+    blocks.clear();
+    blockUsed = 0;
+    blockCapacity = 0;
+    totalAllocated = 0;
+}
+
+size_t GlyphArena::bytesAllocated() const
+{
+    return totalAllocated;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump pointer allocator for glyph bitmaps. Allocations are never freed individually, the whole
+// arena is released at once by release() or on destruction.
+class GlyphArena {
+    public:
+
+    GlyphArena(size_t blockSize = 1 << 20);
+
+    // Returns bytes of uninitialised storage, nullptr for a zero sized request.
+    unsigned char *allocate(size_t bytes);
+
+    // Takes ownership of all of other's blocks, other is left empty.
+    void adopt(GlyphArena &other);
+
+    void release();
+
+    size_t bytesAllocated() const;
+
+    private:
+
+    std::vector<std::unique_ptr<unsigned char[]>> blocks;
+    size_t blockSize;
+    size_t blockUsed;
+    size_t blockCapacity;
+    size_t totalAllocated;
+};
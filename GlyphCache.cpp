@@ -0,0 +1,141 @@
+#include "GlyphCache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#include "Hash.h"
+
+static const char glyphCacheMagic[4] = {'F', 'A', 'G', 'C'};
+static const uint32_t glyphCacheVersion = 1;
+
+struct GlyphCacheRecord {
+    uint32_t index;
+    int32_t w;
+    int32_t h;
+    int32_t bearingX;
+    int32_t bearingY;
+    int32_t advance;
+};
+
+GlyphCache::GlyphCache(std::filesystem::path directory, uint64_t fontHash, int pixelSize, const std::string &renderMode)
+    : file(directory / (hashToHex(fontHash) + "_" + std::to_string(pixelSize) + "_" + renderMode + ".glyphs")), modified(false)
+{
+}
+
+void GlyphCache::load()
+{
+    std::ifstream in(file, std::ios::in | std::ios::binary);
+    if (!in)
+    {
+        return;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t count = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char *)&version, sizeof(version));
+    in.read((char *)&count, sizeof(count));
+    if (!in || memcmp(magic, glyphCacheMagic, sizeof(magic)) != 0 || version != glyphCacheVersion)
+    {
+        std::cout << "GlyphCache::load() -> Ignoring unreadable cache " << file << std::endl;
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        GlyphCacheRecord record;
+        in.read((char *)&record, sizeof(record));
+        if (!in || record.w < 0 || record.h < 0)
+        {
+            break;
+        }
+
+        Glyph glyph = {record.w, record.h, record.bearingX, record.bearingY, record.advance, pixels.size()};
+        pixels.resize(pixels.size() + (size_t)record.w * record.h);
+        in.read((char *)pixels.data() + glyph.offset, (size_t)record.w * record.h);
+        if (!in)
+        {
+            pixels.resize(glyph.offset);
+            break;
+        }
+        glyphs[record.index] = glyph;
+    }
+    std::cout << "GlyphCache::load() -> Loaded " << glyphs.size() << " cached glyphs from " << file << std::endl;
+}
+
+const GlyphCache::Glyph *GlyphCache::find(unsigned int index) const
+{
+    auto glyph = glyphs.find(index);
+    return glyph == glyphs.end() ? nullptr : &glyph->second;
+}
+
+const unsigned char *GlyphCache::glyphPixels(const Glyph &glyph) const
+{
+    return pixels.data() + glyph.offset;
+}
+
+void GlyphCache::add(unsigned int index, const Glyph &glyph, const unsigned char *data)
+{
+    if (glyphs.count(index))
+    {
+        return;
+    }
+
+    Glyph stored = glyph;
+    stored.offset = pixels.size();
+    pixels.insert(pixels.end(), data, data + (size_t)glyph.w * glyph.h);
+    glyphs[index] = stored;
+    modified = true;
+}
+
+void GlyphCache::save()
+{
+    if (!modified)
+    {
+        return;
+    }
+
+    // write a temporary file and rename it over the old one so readers never see a partial cache
+    std::error_code error;
+    std::filesystem::create_directories(file.parent_path(), error);
+    std::filesystem::path staging = file;
+    staging += ".tmp" + std::to_string(std::random_device()());
+
+    std::ofstream out(staging, std::ios::out | std::ios::binary);
+    if (!out)
+    {
+        std::cout << "GlyphCache::save() -> Unable to open " << staging << " for writing" << std::endl;
+        return;
+    }
+
+    uint32_t count = glyphs.size();
+    out.write(glyphCacheMagic, sizeof(glyphCacheMagic));
+    out.write((const char *)&glyphCacheVersion, sizeof(glyphCacheVersion));
+    out.write((const char *)&count, sizeof(count));
+    for (auto &g : glyphs)
+    {
+        const Glyph &glyph = g.second;
+        GlyphCacheRecord record = {g.first, glyph.w, glyph.h, glyph.bearingX, glyph.bearingY, glyph.advance};
+        out.write((const char *)&record, sizeof(record));
+        out.write((const char *)glyphPixels(glyph), (size_t)glyph.w * glyph.h);
+    }
+    out.close();
+
+    std::filesystem::rename(staging, file, error);
+    if (error)
+    {
+        std::cout << "GlyphCache::save() -> Failed to write " << file << ": " << error.message() << std::endl;
+        std::filesystem::remove(staging, error);
+        return;
+    }
+    modified = false;
+    std::cout << "GlyphCache::save() -> Saved " << count << " glyphs to " << file << std::endl;
+}
+
+size_t GlyphCache::glyphCount() const
+{
+    return glyphs.size();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Persistent store of rendered glyphs for one font, pixel size and render mode, so incremental
+// rebuilds only rasterize glyphs that have not been seen before. Glyphs are keyed by glyph index.
+// The file is written in native byte order, it is a local cache and not meant to be shared.
+class GlyphCache {
+    public:
+
+    struct Glyph {
+        int w;
+        int h;
+        int bearingX;
+        int bearingY;
+        int advance;
+        size_t offset; // into pixels
+    };
+
+    GlyphCache(std::filesystem::path directory, uint64_t fontHash, int pixelSize, const std::string &renderMode);
+
+    // Reads the cache file if there is one. Lookups are safe from several threads after this.
+    void load();
+
+    const Glyph *find(unsigned int index) const;
+
+    const unsigned char *glyphPixels(const Glyph &glyph) const;
+
+    void add(unsigned int index, const Glyph &glyph, const unsigned char *data);
+
+    // Rewrites the cache file if glyphs were added since load().
+    void save();
+
+    size_t glyphCount() const;
+
+    private:
+
+    std::filesystem::path file;
+    std::unordered_map<unsigned int, Glyph> glyphs;
+    std::vector<unsigned char> pixels;
+    bool modified;
+};
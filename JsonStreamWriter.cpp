@@ -0,0 +1,61 @@
+#include "JsonStreamWriter.h"
+
+#include <charconv>
+#include <cstring>
+
+JsonStreamWriter::JsonStreamWriter(std::ostream &out) : out(out), used(0)
+{
+}
+
+JsonStreamWriter::~JsonStreamWriter()
+{
+    flush();
+}
+
+void JsonStreamWriter::raw(std::string_view text)
+{
+    if (used + text.size() > sizeof(buffer))
+    {
+        flush();
+        if (text.size() > sizeof(buffer))
+        {
+            out.write(text.data(), text.size());
+            return;
+        }
+    }
+    memcpy(buffer + used, text.data(), text.size());
+    used += text.size();
+}
+
+void JsonStreamWriter::raw(char c)
+{
+    if (used == sizeof(buffer))
+    {
+        flush();
+    }
+    buffer[used++] = c;
+}
+
+void JsonStreamWriter::key(std::string_view name)
+{
+    value(nlohmann::json(name));
+    raw(':');
+}
+
+void JsonStreamWriter::integer(long long value)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    raw(std::string_view(digits, result.ptr - digits));
+}
+
+void JsonStreamWriter::value(const nlohmann::json &value)
+{
+    raw(value.dump());
+}
+
+void JsonStreamWriter::flush()
+{
+    out.write(buffer, used);
+    used = 0;
+}
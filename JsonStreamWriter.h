@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string_view>
+
+#include <nlohmann/json.hpp>
+
+// Writes JSON text to a stream through a fixed size buffer. Values are formatted the way
+// nlohmann::json::dump() formats them (compact, no whitespace), so a document can be streamed
+// piece by piece and still match a dump() of the whole tree byte for byte.
+class JsonStreamWriter {
+    public:
+
+    JsonStreamWriter(std::ostream &out);
+
+    ~JsonStreamWriter();
+
+    // Writes text as is, for structural characters such as '{' or ','.
+    void raw(std::string_view text);
+
+    void raw(char c);
+
+    // Writes "name": with the name escaped.
+    void key(std::string_view name);
+
+    void integer(long long value);
+
+    void value(const nlohmann::json &value);
+
+    void flush();
+
+    private:
+
+    std::ostream &out;
+    char buffer[1 << 16];
+    size_t used;
+};
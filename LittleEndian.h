@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Little endian serialisation for the binary manifest and texture headers, independent of the
+// host byte order.
+
+inline void putU16(std::vector<unsigned char> &out, uint16_t v)
+{
+    out.push_back(v & 0xff);
+    out.push_back(v >> 8);
+}
+
+inline void putU32(std::vector<unsigned char> &out, uint32_t v)
+{
+    putU16(out, v & 0xffff);
+    putU16(out, v >> 16);
+}
+
+inline void putU64(std::vector<unsigned char> &out, uint64_t v)
+{
+    putU32(out, (uint32_t)v);
+    putU32(out, (uint32_t)(v >> 32));
+}
+
+// Overwrites 8 bytes at `at`, for offsets that are only known once later data is laid out.
+inline void setU64(std::vector<unsigned char> &out, size_t at, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        out[at + i] = (v >> (8 * i)) & 0xff;
+    }
+}
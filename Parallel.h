@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Resolves a requested worker count, where 0 or less means one per hardware thread.
+inline int resolveThreadCount(int requested)
+{
+    if (requested > 0)
+    {
+        return requested;
+    }
+    int hardware = (int)std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+}
+
+// Splits [0, count) into at most `shards` contiguous ranges and calls fn(shard, begin, end) for each.
+// Shard 0 runs on the calling thread, the rest on their own threads; returns once all have finished.
+template <typename F>
+void parallelFor(size_t count, int shards, F fn)
+{
+    shards = std::max(1, std::min(shards, (int)count));
+    size_t chunk = (count + shards - 1) / shards;
+
+    std::vector<std::thread> workers;
+    for (int s = 1; s < shards; ++s)
+    {
+        size_t begin = std::min(count, s * chunk);
+        size_t end = std::min(count, begin + chunk);
+        workers.emplace_back(fn, s, begin, end);
+    }
+    fn(0, (size_t)0, std::min(count, chunk));
+
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+}
+
+// Calls fn(worker, index) for every index in [0, count) on up to `threads` threads. Indices are handed
+// out one at a time, which suits a small number of uneven work items.
+template <typename F>
+void parallelForEach(size_t count, int threads, F fn)
+{
+    threads = std::max(1, std::min(threads, (int)count));
+    std::atomic<size_t> next(0);
+    auto work = [&](int worker) {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            fn(worker, i);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; ++t)
+    {
+        workers.emplace_back(work, t);
+    }
+    work(0);
+
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+}
@@ -0,0 +1,336 @@
+#include "PngEncoder.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <png.h>
+#include <zlib.h>
+#include <stb_image_write.h>
+
+#include "Parallel.h"
+
+// PNG row filter types, see the PNG specification section 9
+enum PngFilter { FilterNone = 0, FilterSub = 1, FilterUp = 2, FilterAverage = 3, FilterPaeth = 4, FilterAdaptive = 5 };
+
+static int filterFromName(const std::string &name)
+{
+    static const char *names[] = {"none", "sub", "up", "average", "paeth", "adaptive"};
+    for (int f = 0; f <= FilterAdaptive; ++f)
+    {
+        if (name == names[f])
+        {
+            return f;
+        }
+    }
+    std::cout << "Unknown PNG filter '" << name << "' defaulting to adaptive" << std::endl;
+    return FilterAdaptive;
+}
+
+static bool writeWithLibpng(const std::string &path, const unsigned char *pixels, int width, int height, int channels,
+                            int level, int filter)
+{
+    static const int colorTypes[] = {PNG_COLOR_TYPE_GRAY, PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_RGB_ALPHA};
+    static const int filterFlags[] = {PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH, PNG_ALL_FILTERS};
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    // libpng reports errors with longjmp, which skips destructors, so nothing that owns memory
+    // may be created after setjmp
+    std::vector<png_const_bytep> rows(height);
+    for (int y = 0; y < height; ++y)
+    {
+        rows[y] = pixels + (size_t)y * width * channels;
+    }
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    if (!info || setjmp(png_jmpbuf(png)))
+    {
+        png_destroy_write_struct(&png, &info);
+        fclose(file);
+        return false;
+    }
+
+    png_init_io(png, file);
+    png_set_IHDR(png, info, width, height, 8, colorTypes[channels - 1], PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_set_compression_level(png, level < 0 ? Z_DEFAULT_COMPRESSION : level);
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, filterFlags[filter]);
+    png_write_info(png, info);
+    png_write_rows(png, (png_bytepp)rows.data(), height);
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    return fclose(file) == 0;
+}
+
+static unsigned char paethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+    {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// Writes the filter type byte and the filtered bytes of one row to out, prev is nullptr for the
+// first row of the image. The first bpp bytes of a row have no left neighbour and use 0 for it.
+static void filterRow(int filter, const unsigned char *row, const unsigned char *prev, int stride, int bpp,
+                      unsigned char *out)
+{
+    out[0] = filter;
+    unsigned char *filtered = out + 1;
+    int lead = std::min(bpp, stride);
+    switch (filter)
+    {
+    case FilterNone:
+        memcpy(filtered, row, stride);
+        break;
+    case FilterSub:
+        memcpy(filtered, row, lead);
+        for (int i = lead; i < stride; ++i)
+        {
+            filtered[i] = row[i] - row[i - bpp];
+        }
+        break;
+    case FilterUp:
+        if (!prev)
+        {
+            memcpy(filtered, row, stride);
+            break;
+        }
+        for (int i = 0; i < stride; ++i)
+        {
+            filtered[i] = row[i] - prev[i];
+        }
+        break;
+    case FilterAverage:
+        for (int i = 0; i < lead; ++i)
+        {
+            filtered[i] = row[i] - ((prev ? prev[i] : 0) >> 1);
+        }
+        for (int i = lead; i < stride; ++i)
+        {
+            filtered[i] = row[i] - ((row[i - bpp] + (prev ? prev[i] : 0)) >> 1);
+        }
+        break;
+    default:
+        // with no previous row Paeth always predicts the left neighbour, the same as Sub
+        if (!prev)
+        {
+            memcpy(filtered, row, lead);
+            for (int i = lead; i < stride; ++i)
+            {
+                filtered[i] = row[i] - row[i - bpp];
+            }
+            break;
+        }
+        for (int i = 0; i < lead; ++i)
+        {
+            filtered[i] = row[i] - prev[i];
+        }
+        for (int i = lead; i < stride; ++i)
+        {
+            filtered[i] = row[i] - paethPredictor(row[i - bpp], prev[i], prev[i - bpp]);
+        }
+        break;
+    }
+}
+
+// Adaptive filtering picks the filter with the smallest sum of absolute signed residuals per row,
+// the heuristic the PNG specification recommends.
+static void filterRowAdaptive(const unsigned char *row, const unsigned char *prev, int stride, int bpp,
+                              unsigned char *out, std::vector<unsigned char> &scratch)
+{
+    scratch.resize(stride + 1);
+    long long bestCost = -1;
+    for (int filter = FilterNone; filter <= FilterPaeth; ++filter)
+    {
+        filterRow(filter, row, prev, stride, bpp, scratch.data());
+        long long cost = 0;
+        for (int i = 1; i <= stride; ++i)
+        {
+            cost += std::abs((int)(signed char)scratch[i]);
+        }
+        if (bestCost < 0 || cost < bestCost)
+        {
+            bestCost = cost;
+            memcpy(out, scratch.data(), stride + 1);
+        }
+    }
+}
+
+static void putChunk(std::ofstream &file, const char *type, const unsigned char *data, size_t size)
+{
+    unsigned char header[8] = {(unsigned char)(size >> 24), (unsigned char)(size >> 16), (unsigned char)(size >> 8),
+                               (unsigned char)size};
+    memcpy(header + 4, type, 4);
+    uLong crc = crc32(0, header + 4, 4);
+    // crc32 returns 0 for a null buffer and would drop the type from the CRC of empty chunks like IEND
+    if (size > 0)
+    {
+        crc = crc32(crc, data, (uInt)size);
+    }
+    unsigned char footer[4] = {(unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8),
+                               (unsigned char)crc};
+    file.write((const char *)header, 8);
+    if (size > 0)
+    {
+        file.write((const char *)data, size);
+    }
+    file.write((const char *)footer, 4);
+}
+
+// Splits the image into horizontal bands that are filtered and deflated on their own threads, then
+// stitches them into one zlib stream the way pigz does: every band but the last ends on a byte
+// aligned sync flush, and each band is primed with the last 32 KB of filtered data before it so
+// the compression ratio stays close to a single stream.
+static bool writeParallel(const std::string &path, const unsigned char *pixels, int width, int height, int channels,
+                          int level, int filter, int threads)
+{
+    int stride = width * channels;
+    size_t filteredStride = (size_t)stride + 1;
+    const size_t window = 32768;
+    // bands of at least 256 KB of filtered data, smaller ones cost more in flushes than they gain
+    int bands = std::max(1, std::min(resolveThreadCount(threads), (int)(filteredStride * height / (256 * 1024))));
+    int rowsPerBand = (height + bands - 1) / bands;
+    bands = std::max(1, (height + rowsPerBand - 1) / std::max(1, rowsPerBand));
+
+    std::vector<std::vector<unsigned char>> compressed(bands);
+    std::vector<uLong> checksums(bands);
+    std::vector<size_t> lengths(bands);
+    std::vector<char> failed(bands, 0);
+
+    parallelFor(bands, bands, [&](int shard, size_t begin, size_t end) {
+        for (size_t band = begin; band < end; ++band)
+        {
+            int firstRow = (int)band * rowsPerBand;
+            int lastRow = std::min(height, firstRow + rowsPerBand);
+            // rows before the band are filtered again, only to prime the dictionary
+            int primeRows = band == 0 ? 0 : std::min(firstRow, (int)((window + filteredStride - 1) / filteredStride));
+
+            std::vector<unsigned char> filtered((size_t)(lastRow - firstRow + primeRows) * filteredStride);
+            std::vector<unsigned char> scratch;
+            for (int y = firstRow - primeRows; y < lastRow; ++y)
+            {
+                const unsigned char *row = pixels + (size_t)y * stride;
+                const unsigned char *prev = y > 0 ? row - stride : nullptr;
+                unsigned char *out = filtered.data() + (size_t)(y - firstRow + primeRows) * filteredStride;
+                if (filter == FilterAdaptive)
+                {
+                    filterRowAdaptive(row, prev, stride, channels, out, scratch);
+                }
+                else
+                {
+                    filterRow(filter, row, prev, stride, channels, out);
+                }
+            }
+            const unsigned char *data = filtered.data() + (size_t)primeRows * filteredStride;
+            size_t dataSize = (size_t)(lastRow - firstRow) * filteredStride;
+            checksums[band] = adler32(1, data, (uInt)dataSize);
+            lengths[band] = dataSize;
+
+            z_stream stream = {};
+            if (deflateInit2(&stream, level < 0 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            {
+                failed[band] = 1;
+                continue;
+            }
+            if (primeRows > 0)
+            {
+                size_t primeSize = std::min(window, (size_t)primeRows * filteredStride);
+                deflateSetDictionary(&stream, data - primeSize, (uInt)primeSize);
+            }
+
+            auto &out = compressed[band];
+            out.resize(deflateBound(&stream, dataSize) + 16);
+            stream.next_in = (Bytef *)data;
+            stream.avail_in = (uInt)dataSize;
+            stream.next_out = out.data();
+            stream.avail_out = (uInt)out.size();
+            int result = deflate(&stream, band + 1 == (size_t)bands ? Z_FINISH : Z_SYNC_FLUSH);
+            bool complete = band + 1 == (size_t)bands ? result == Z_STREAM_END : result == Z_OK && stream.avail_in == 0 && stream.avail_out > 0;
+            out.resize(stream.total_out);
+            deflateEnd(&stream);
+            failed[band] = !complete;
+        }
+    });
+
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end())
+    {
+        std::cout << "writePng -> Compressing " << path << " failed" << std::endl;
+        return false;
+    }
+
+    // zlib header for the chosen level, the FLEVEL bits are informational only
+    int flevel = level < 0 || level == 6 ? 2 : level < 2 ? 0 : level < 6 ? 1 : 3;
+    unsigned char zlibHeader[2] = {0x78, (unsigned char)(flevel << 6)};
+    zlibHeader[1] += 31 - (zlibHeader[0] * 256 + zlibHeader[1]) % 31;
+
+    uLong adler = checksums[0];
+    for (int band = 1; band < bands; ++band)
+    {
+        adler = adler32_combine(adler, checksums[band], (z_off_t)lengths[band]);
+    }
+
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    static const unsigned char colorTypes[] = {0, 4, 2, 6};
+    file.write((const char *)signature, 8);
+    unsigned char ihdr[13] = {(unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8),
+                              (unsigned char)width, (unsigned char)(height >> 24), (unsigned char)(height >> 16),
+                              (unsigned char)(height >> 8), (unsigned char)height, 8, colorTypes[channels - 1], 0, 0, 0};
+    putChunk(file, "IHDR", ihdr, sizeof(ihdr));
+
+    // one IDAT chunk per band keeps chunks well below the 2^31 byte limit
+    std::vector<unsigned char> first(zlibHeader, zlibHeader + 2);
+    first.insert(first.end(), compressed[0].begin(), compressed[0].end());
+    compressed[0].swap(first);
+    unsigned char trailer[4] = {(unsigned char)(adler >> 24), (unsigned char)(adler >> 16), (unsigned char)(adler >> 8),
+                                (unsigned char)adler};
+    compressed.back().insert(compressed.back().end(), trailer, trailer + 4);
+    for (auto &band : compressed)
+    {
+        putChunk(file, "IDAT", band.data(), band.size());
+    }
+    putChunk(file, "IEND", nullptr, 0);
+    file.close();
+    return !file.fail();
+}
+
+bool writePng(const std::string &path, const unsigned char *pixels, int width, int height, int channels,
+              const PngOptions &options)
+{
+    if (options.encoder == "libpng")
+    {
+        return writeWithLibpng(path, pixels, width, height, channels, options.level, filterFromName(options.filter));
+    }
+    if (options.encoder == "parallel")
+    {
+        return writeParallel(path, pixels, width, height, channels, options.level, filterFromName(options.filter),
+                             options.threads);
+    }
+    if (options.encoder != "stb")
+    {
+        std::cout << "Unknown PNG encoder '" << options.encoder << "' defaulting to stb" << std::endl;
+    }
+    return stbi_write_png(path.c_str(), width, height, channels, pixels, width * channels) != 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+struct PngOptions {
+    std::string encoder = "stb"; // stb (stb_image_write), libpng, or parallel (zlib on row bands)
+    int level = -1; // zlib compression level 0-9, -1 = zlib default; libpng and parallel only
+    std::string filter = "adaptive"; // none, sub, up, average, paeth or adaptive (best per row); libpng and parallel only
+    int threads = 0; // bands compressed at once by the parallel encoder, 0 = one per hardware thread
+};
+
+// Writes an 8 bit image with 1 to 4 interleaved channels, rows packed width * channels bytes
+// apart. Returns false if the file could not be written.
+bool writePng(const std::string &path, const unsigned char *pixels, int width, int height, int channels,
+              const PngOptions &options);
@@ -0,0 +1,211 @@
+#include "SdfGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SDF_GENERATOR_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SDF_GENERATOR_NEON
+#endif
+
+// Working memory of one thread, reused from glyph to glyph
+struct SdfScratch {
+    std::vector<int16_t> toInside; // vertical distance to the nearest inside pixel of the column
+    std::vector<int16_t> toOutside; // and to the nearest outside pixel
+    std::vector<int16_t> far; // distance used above the first row, further than any real one
+    std::vector<float> parabolas;
+    std::vector<float> boundaries;
+    std::vector<int> vertices;
+    std::vector<float> insideRow;
+    std::vector<float> outsideRow;
+    std::vector<float> sums;
+};
+
+// Downwards step of the vertical pass over one row: a pixel of the feature set is 0, any other
+// pixel is one more than the pixel above it. Eight columns at a time in 16 bit lanes, saturating
+// instead of overflowing.
+static void columnStep(const unsigned char *coverage, const int16_t *aboveIn, const int16_t *aboveOut, int16_t *in,
+                       int16_t *out, int width)
+{
+    int x = 0;
+#if defined(SDF_GENERATOR_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i belowHalf = _mm_set1_epi16(127);
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(coverage + x)), zero);
+        __m128i inside = _mm_cmpgt_epi16(c, belowHalf);
+        __m128i nextIn = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(aboveIn + x)), one);
+        __m128i nextOut = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(aboveOut + x)), one);
+        _mm_storeu_si128((__m128i *)(in + x), _mm_andnot_si128(inside, nextIn));
+        _mm_storeu_si128((__m128i *)(out + x), _mm_and_si128(inside, nextOut));
+    }
+#elif defined(SDF_GENERATOR_NEON)
+    const int16x8_t one = vdupq_n_s16(1);
+    for (; x + 8 <= width; x += 8)
+    {
+        int16x8_t inside = vreinterpretq_s16_u16(vcgeq_u16(vmovl_u8(vld1_u8(coverage + x)), vdupq_n_u16(128)));
+        int16x8_t nextIn = vqaddq_s16(vld1q_s16(aboveIn + x), one);
+        int16x8_t nextOut = vqaddq_s16(vld1q_s16(aboveOut + x), one);
+        vst1q_s16(in + x, vbicq_s16(nextIn, inside));
+        vst1q_s16(out + x, vandq_s16(nextOut, inside));
+    }
+#endif
+    for (; x < width; ++x)
+    {
+        bool inside = coverage[x] >= 128;
+        in[x] = inside ? 0 : std::min(aboveIn[x] + 1, (int)INT16_MAX);
+        out[x] = inside ? std::min(aboveOut[x] + 1, (int)INT16_MAX) : 0;
+    }
+}
+
+// Upwards step of the vertical pass: keeps the smaller of a pixel's distance and the distance of
+// the pixel below it plus one.
+static void columnMin(int16_t *row, const int16_t *below, int width)
+{
+    int x = 0;
+#if defined(SDF_GENERATOR_SSE2)
+    const __m128i one = _mm_set1_epi16(1);
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i fromBelow = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(below + x)), one);
+        _mm_storeu_si128((__m128i *)(row + x), _mm_min_epi16(_mm_loadu_si128((const __m128i *)(row + x)), fromBelow));
+    }
+#elif defined(SDF_GENERATOR_NEON)
+    const int16x8_t one = vdupq_n_s16(1);
+    for (; x + 8 <= width; x += 8)
+    {
+        vst1q_s16(row + x, vminq_s16(vld1q_s16(row + x), vqaddq_s16(vld1q_s16(below + x), one)));
+    }
+#endif
+    for (; x < width; ++x)
+    {
+        row[x] = std::min((int)row[x], below[x] + 1);
+    }
+}
+
+// Squared distance from every pixel of a row to the nearest feature pixel, given each pixel's
+// vertical distance g to the nearest feature in its column: the lower envelope of the parabolas
+// (x - q)^2 + g(q)^2, built left to right and then read back in a second sweep.
+static void rowDistances(const int16_t *g, int n, SdfScratch &scratch, float *d)
+{
+    const float infinity = std::numeric_limits<float>::infinity();
+    float *f = scratch.parabolas.data();
+    float *z = scratch.boundaries.data();
+    int *v = scratch.vertices.data();
+    for (int q = 0; q < n; ++q)
+    {
+        f[q] = (float)g[q] * g[q];
+    }
+
+    int k = 0;
+    v[0] = 0;
+    z[0] = -infinity;
+    z[1] = infinity;
+    for (int q = 1; q < n; ++q)
+    {
+        float s;
+        while (true)
+        {
+            int p = v[k];
+            s = ((f[q] + (float)q * q) - (f[p] + (float)p * p)) / (2.f * (q - p));
+            if (s > z[k])
+            {
+                break;
+            }
+            k--;
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = infinity;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; ++q)
+    {
+        while (z[k + 1] < q)
+        {
+            k++;
+        }
+        float dx = (float)(q - v[k]);
+        d[q] = dx * dx + f[v[k]];
+    }
+}
+
+void coverageToSdf(const unsigned char *coverage, int pitch, int width, int height, int oversample, int spread,
+                   unsigned char *sdf, int sdfPitch)
+{
+    int w = width * oversample;
+    int h = height * oversample;
+    if (w <= 0 || h <= 0)
+    {
+        return;
+    }
+
+    thread_local SdfScratch scratch;
+    scratch.toInside.resize((size_t)w * h);
+    scratch.toOutside.resize((size_t)w * h);
+    scratch.far.assign(w, (int16_t)std::min(w + h, (int)INT16_MAX));
+    scratch.parabolas.resize(w);
+    scratch.boundaries.resize(w + 1);
+    scratch.vertices.resize(w);
+    scratch.insideRow.resize(w);
+    scratch.outsideRow.resize(w);
+    scratch.sums.resize(width);
+
+    // vertical pass, down then up every column
+    for (int y = 0; y < h; ++y)
+    {
+        int16_t *in = scratch.toInside.data() + (size_t)y * w;
+        int16_t *out = scratch.toOutside.data() + (size_t)y * w;
+        columnStep(coverage + (size_t)y * pitch, y ? in - w : scratch.far.data(), y ? out - w : scratch.far.data(), in,
+                   out, w);
+    }
+    for (int y = h - 2; y >= 0; --y)
+    {
+        columnMin(scratch.toInside.data() + (size_t)y * w, scratch.toInside.data() + (size_t)(y + 1) * w, w);
+        columnMin(scratch.toOutside.data() + (size_t)y * w, scratch.toOutside.data() + (size_t)(y + 1) * w, w);
+    }
+
+    // horizontal pass row by row, summing the signed distances of each output pixel's block.
+    // Distances run between pixel centres, so the outline lies half a pixel from the nearest one.
+    float scale = 128.f / ((float)spread * oversample * oversample * oversample);
+    for (int y = 0; y < h; ++y)
+    {
+        if (y % oversample == 0)
+        {
+            std::fill(scratch.sums.begin(), scratch.sums.end(), 0.f);
+        }
+        rowDistances(scratch.toInside.data() + (size_t)y * w, w, scratch, scratch.insideRow.data());
+        rowDistances(scratch.toOutside.data() + (size_t)y * w, w, scratch, scratch.outsideRow.data());
+
+        const unsigned char *row = coverage + (size_t)y * pitch;
+        for (int ox = 0; ox < width; ++ox)
+        {
+            float sum = 0.f;
+            for (int x = ox * oversample; x < (ox + 1) * oversample; ++x)
+            {
+                sum += row[x] >= 128 ? std::sqrt(scratch.outsideRow[x]) - 0.5f : 0.5f - std::sqrt(scratch.insideRow[x]);
+            }
+            scratch.sums[ox] += sum;
+        }
+
+        if (y % oversample == oversample - 1)
+        {
+            unsigned char *dst = sdf + (size_t)(y / oversample) * sdfPitch;
+            for (int ox = 0; ox < width; ++ox)
+            {
+                float value = std::clamp(128.f + scratch.sums[ox] * scale, 0.f, 255.f);
+                dst[ox] = (unsigned char)(value + 0.5f);
+            }
+        }
+    }
+}
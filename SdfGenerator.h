@@ -0,0 +1,10 @@
+#pragma once
+
+// Converts a coverage bitmap rendered `oversample` times larger than the distance field, rows
+// `pitch` bytes apart, to a width x height signed distance field written to sdf, rows sdfPitch
+// bytes apart. Pixels of at least half coverage are inside. Distances come from an exact Euclidean
+// distance transform of the oversampled pixels (Felzenszwalb and Huttenlocher), each output pixel
+// averages its oversample x oversample block. Like FreeType's SDF renderer the outline is 128,
+// inside is brighter and `spread` output pixels from the outline reach 0 or 255.
+void coverageToSdf(const unsigned char *coverage, int pitch, int width, int height, int oversample, int spread,
+                   unsigned char *sdf, int sdfPitch);
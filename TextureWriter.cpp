@@ -0,0 +1,347 @@
+#include "TextureWriter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXTURE_WRITER_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TEXTURE_WRITER_NEON
+#endif
+
+#include "BlockCompressor.h"
+#include "LittleEndian.h"
+#include "Parallel.h"
+
+// Averages the 2x2 squares of two source rows into `width` destination pixels of `channels` bytes,
+// (a + b + c + d + 2) / 4 like the scalar filter. Returns how many pixels were written, the caller
+// filters the rest.
+static int downsampleRowSimd(const unsigned char *row0, const unsigned char *row1, unsigned char *dst, int width,
+                             int channels)
+{
+    int x = 0;
+#if defined(TEXTURE_WRITER_SSE2)
+    const __m128i two = _mm_set1_epi16(2);
+    if (channels == 1)
+    {
+        // 16 destination pixels from 32 source pixels, even and odd pixels split into 16 bit lanes
+        const __m128i lowBytes = _mm_set1_epi16(0xff);
+        for (; x + 16 <= width; x += 16)
+        {
+            __m128i sums[2];
+            for (int half = 0; half < 2; ++half)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i *)(row0 + 2 * x + 16 * half));
+                __m128i b = _mm_loadu_si128((const __m128i *)(row1 + 2 * x + 16 * half));
+                __m128i sum = _mm_add_epi16(_mm_and_si128(a, lowBytes), _mm_srli_epi16(a, 8));
+                sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_and_si128(b, lowBytes), _mm_srli_epi16(b, 8)));
+                sums[half] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+            }
+            _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(sums[0], sums[1]));
+        }
+    }
+    else if (channels == 4)
+    {
+        // 4 destination pixels from 8 source pixels, widened two pixels to a register so the
+        // neighbours sit in its low and high half
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i sums[2];
+            for (int half = 0; half < 2; ++half)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i *)(row0 + 8 * x + 16 * half));
+                __m128i b = _mm_loadu_si128((const __m128i *)(row1 + 8 * x + 16 * half));
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                sums[half] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+            }
+            _mm_storeu_si128((__m128i *)(dst + 4 * x), _mm_packus_epi16(sums[0], sums[1]));
+        }
+    }
+#elif defined(TEXTURE_WRITER_NEON)
+    if (channels == 1)
+    {
+        // pairwise widening adds, then a rounding narrowing shift does the + 2 and / 4
+        for (; x + 16 <= width; x += 16)
+        {
+            uint16x8_t lo = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * x)), vpaddlq_u8(vld1q_u8(row1 + 2 * x)));
+            uint16x8_t hi = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * x + 16)), vpaddlq_u8(vld1q_u8(row1 + 2 * x + 16)));
+            vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+        }
+    }
+    else if (channels == 4)
+    {
+        // 8 destination pixels from 16 source pixels, deinterleaved into one register per channel
+        for (; x + 8 <= width; x += 8)
+        {
+            uint8x16x4_t a = vld4q_u8(row0 + 8 * x);
+            uint8x16x4_t b = vld4q_u8(row1 + 8 * x);
+            uint8x8x4_t out;
+            for (int c = 0; c < 4; ++c)
+            {
+                out.val[c] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c])), 2);
+            }
+            vst4_u8(dst + 4 * x, out);
+        }
+    }
+#endif
+    return x;
+}
+
+MipChain::MipChain(const unsigned char *pixels, int width, int height, int channels, int levels, int threads)
+{
+    int count = fullChainLength(width, height);
+    if (levels > 0)
+    {
+        count = std::min(count, levels);
+    }
+
+    this->levels.push_back({width, height, pixels});
+    storage.reserve(count);
+    for (int level = 1; level < count; ++level)
+    {
+        const MipLevel &src = this->levels.back();
+        int w = std::max(1, src.width / 2);
+        int h = std::max(1, src.height / 2);
+        storage.emplace_back((size_t)w * h * channels);
+        unsigned char *dst = storage.back().data();
+
+        // rows are independent, small levels are not worth a thread
+        int shards = std::min(resolveThreadCount(threads), (h + 63) / 64);
+        parallelFor(h, shards, [&](int shard, size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y)
+            {
+                // odd sizes drop the last row or column, a 1 pixel wide side repeats its only texel
+                const unsigned char *row0 = src.data + (size_t)std::min(2 * (int)y, src.height - 1) * src.width * channels;
+                const unsigned char *row1 = src.data + (size_t)std::min(2 * (int)y + 1, src.height - 1) * src.width * channels;
+                unsigned char *out = dst + y * w * channels;
+                int x = src.width > 1 ? downsampleRowSimd(row0, row1, out, w, channels) : 0;
+                for (; x < w; ++x)
+                {
+                    int x0 = std::min(2 * x, src.width - 1) * channels;
+                    int x1 = std::min(2 * x + 1, src.width - 1) * channels;
+                    for (int c = 0; c < channels; ++c)
+                    {
+                        out[x * channels + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2;
+                    }
+                }
+            }
+        });
+        this->levels.push_back({w, h, dst});
+    }
+}
+
+int MipChain::fullChainLength(int width, int height)
+{
+    int count = 1;
+    for (int size = std::max(width, height); size > 1; size /= 2)
+    {
+        count++;
+    }
+    return count;
+}
+
+std::string imageExtension(const std::string &format)
+{
+    if (format == "png" || format == "raw" || format == "ktx2" || format == "dds")
+    {
+        return "." + format;
+    }
+    return "";
+}
+
+// Level data as it is stored in the file
+struct EncodedLevel {
+    const unsigned char *data;
+    size_t size;
+};
+
+// KTX 2.0, see https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+static std::vector<unsigned char> ktx2Header(const MipChain &chain, TextureFormat format,
+                                             const std::vector<EncodedLevel> &levels, std::vector<size_t> &levelOffsets)
+{
+    const uint32_t VK_FORMAT_R8_UNORM = 9;
+    const uint32_t VK_FORMAT_R8G8B8A8_UNORM = 37;
+    const uint32_t VK_FORMAT_BC4_UNORM_BLOCK = 139;
+    static const unsigned char identifier[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+    uint32_t levelCount = chain.levels.size();
+
+    // basic data format descriptor: one 8 bit linear sample per channel, or a single 64 bit sample
+    // covering a 4x4 block for BC4
+    std::vector<unsigned char> dfd;
+    bool bc4 = format == TextureFormat::BC4;
+    uint32_t samples = format == TextureFormat::RGBA8 ? 4 : 1;
+    putU32(dfd, 4 + 24 + 16 * samples);
+    putU32(dfd, 0); // vendor Khronos, descriptor type basic
+    putU32(dfd, 2 | ((24 + 16 * samples) << 16)); // version 2, block size
+    putU32(dfd, (bc4 ? 131 : 1) | (1 << 8) | (1 << 16)); // BC4 or RGBSDA colour model, BT.709 primaries, linear transfer
+    putU32(dfd, bc4 ? 3 | (3 << 8) : 0); // texel block dimensions - 1
+    putU32(dfd, bc4 ? 8 : samples); // bytes per plane 0
+    putU32(dfd, 0);
+    static const uint32_t channelIds[4] = {0, 1, 2, 15}; // R, G, B, A
+    for (uint32_t s = 0; s < samples; ++s)
+    {
+        putU32(dfd, (s * 8) | ((bc4 ? 63 : 7) << 16) | (channelIds[s] << 24)); // bit offset, bit length - 1, channel
+        putU32(dfd, 0); // sample position
+        putU32(dfd, 0); // lower
+        putU32(dfd, bc4 ? 0xffffffff : 255); // upper
+    }
+
+    std::vector<unsigned char> kvd;
+    static const char writer[] = "KTXwriter\0fontAtlasTool";
+    putU32(kvd, sizeof(writer));
+    kvd.insert(kvd.end(), writer, writer + sizeof(writer));
+    while (kvd.size() % 4)
+    {
+        kvd.push_back(0);
+    }
+
+    uint32_t levelIndexOffset = 80;
+    uint32_t dfdOffset = levelIndexOffset + 24 * levelCount;
+    uint32_t kvdOffset = dfdOffset + dfd.size();
+
+    std::vector<unsigned char> out(identifier, identifier + 12);
+    putU32(out, bc4 ? VK_FORMAT_BC4_UNORM_BLOCK : samples == 1 ? VK_FORMAT_R8_UNORM : VK_FORMAT_R8G8B8A8_UNORM);
+    putU32(out, 1); // type size
+    putU32(out, chain.levels[0].width);
+    putU32(out, chain.levels[0].height);
+    putU32(out, 0); // depth
+    putU32(out, 0); // layers
+    putU32(out, 1); // faces
+    putU32(out, levelCount);
+    putU32(out, 0); // no supercompression
+    putU32(out, dfdOffset);
+    putU32(out, dfd.size());
+    putU32(out, kvdOffset);
+    putU32(out, kvd.size());
+    putU64(out, 0); // no supercompression global data
+    putU64(out, 0);
+
+    // the level index lists level 0 first, the data is stored smallest level first, every level
+    // aligned to the least common multiple of the texel block size and 4 bytes
+    size_t alignment = bc4 ? 8 : 4;
+    size_t levelIndex = out.size();
+    out.resize(out.size() + 24 * levelCount);
+    out.insert(out.end(), dfd.begin(), dfd.end());
+    out.insert(out.end(), kvd.begin(), kvd.end());
+
+    size_t offset = out.size();
+    levelOffsets.assign(levelCount, 0);
+    for (int level = levelCount - 1; level >= 0; --level)
+    {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        levelOffsets[level] = offset;
+        setU64(out, levelIndex + 24 * level, offset);
+        setU64(out, levelIndex + 24 * level + 8, levels[level].size);
+        setU64(out, levelIndex + 24 * level + 16, levels[level].size);
+        offset += levels[level].size;
+    }
+    return out;
+}
+
+// DDS with the DX10 extension header so the format is an unambiguous DXGI format
+static std::vector<unsigned char> ddsHeader(const MipChain &chain, TextureFormat format, const EncodedLevel &top)
+{
+    const uint32_t DXGI_FORMAT_R8_UNORM = 61;
+    const uint32_t DXGI_FORMAT_R8G8B8A8_UNORM = 28;
+    const uint32_t DXGI_FORMAT_BC4_UNORM = 80;
+    bool mipmapped = chain.levels.size() > 1;
+    bool bc4 = format == TextureFormat::BC4;
+
+    std::vector<unsigned char> out = {'D', 'D', 'S', ' '};
+    putU32(out, 124);
+    // caps, height, width, pixel format, pitch or for BC4 linear size and, with mips, mip map count
+    putU32(out, 0x1 | 0x2 | 0x4 | 0x1000 | (bc4 ? 0x80000 : 0x8) | (mipmapped ? 0x20000 : 0));
+    putU32(out, chain.levels[0].height);
+    putU32(out, chain.levels[0].width);
+    putU32(out, bc4 ? top.size : top.size / chain.levels[0].height);
+    putU32(out, 0); // depth
+    putU32(out, chain.levels.size());
+    for (int i = 0; i < 11; ++i)
+    {
+        putU32(out, 0);
+    }
+    putU32(out, 32); // pixel format size
+    putU32(out, 0x4); // four cc
+    out.insert(out.end(), {'D', 'X', '1', '0'});
+    for (int i = 0; i < 5; ++i)
+    {
+        putU32(out, 0); // bit count and masks
+    }
+    putU32(out, 0x1000 | (mipmapped ? 0x400000 | 0x8 : 0)); // texture, mip map, complex
+    for (int i = 0; i < 4; ++i)
+    {
+        putU32(out, 0);
+    }
+
+    putU32(out, bc4 ? DXGI_FORMAT_BC4_UNORM : format == TextureFormat::R8 ? DXGI_FORMAT_R8_UNORM : DXGI_FORMAT_R8G8B8A8_UNORM);
+    putU32(out, 3); // texture 2d
+    putU32(out, 0);
+    putU32(out, 1); // array size
+    putU32(out, 0);
+    return out;
+}
+
+bool writeTexture(const std::string &path, const std::string &container, const MipChain &chain, TextureFormat format,
+                  int threads)
+{
+    std::vector<EncodedLevel> levels;
+    std::vector<std::vector<unsigned char>> compressed;
+    compressed.reserve(chain.levels.size());
+    for (auto &level : chain.levels)
+    {
+        if (format == TextureFormat::BC4)
+        {
+            compressed.emplace_back(bc4Size(level.width, level.height));
+            compressBC4(level.data, level.width, level.height, compressed.back().data(), threads);
+            levels.push_back({compressed.back().data(), compressed.back().size()});
+        }
+        else
+        {
+            int channels = format == TextureFormat::RGBA8 ? 4 : 1;
+            levels.push_back({level.data, (size_t)level.width * level.height * channels});
+        }
+    }
+
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    if (container == "ktx2")
+    {
+        std::vector<size_t> levelOffsets;
+        std::vector<unsigned char> header = ktx2Header(chain, format, levels, levelOffsets);
+        file.write((const char *)header.data(), header.size());
+        size_t written = header.size();
+        static const char padding[8] = {};
+        for (int level = (int)levels.size() - 1; level >= 0; --level)
+        {
+            file.write(padding, levelOffsets[level] - written);
+            file.write((const char *)levels[level].data, levels[level].size);
+            written = levelOffsets[level] + levels[level].size;
+        }
+    }
+    else
+    {
+        if (container == "dds")
+        {
+            std::vector<unsigned char> header = ddsHeader(chain, format, levels[0]);
+            file.write((const char *)header.data(), header.size());
+        }
+        for (auto &level : levels)
+        {
+            file.write((const char *)level.data, level.size);
+        }
+    }
+    file.close();
+    return !file.fail();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// One level of a mip chain, rows packed width * channels bytes apart.
+struct MipLevel {
+    int width;
+    int height;
+    const unsigned char *data;
+};
+
+// Level 0 borrows the source pixels, every further level halves the one before it with a 2x2 box
+// filter (SSE2 or NEON for 1 and 4 channels) and is owned by the chain.
+class MipChain {
+    public:
+
+    // levels is the number of levels wanted, 0 = down to 1x1. It is clamped to the full chain.
+    // Rows of large levels are filtered on `threads` threads, 0 = one per hardware thread.
+    MipChain(const unsigned char *pixels, int width, int height, int channels, int levels, int threads = 1);
+
+    // Number of levels in the full chain of a width x height image.
+    static int fullChainLength(int width, int height);
+
+    std::vector<MipLevel> levels;
+
+    private:
+
+    std::vector<std::vector<unsigned char>> storage;
+};
+
+// Pixel format of a written texture. BC4 is compressed from single channel levels when written.
+enum class TextureFormat { R8, RGBA8, BC4 };
+
+// File extension, including the dot, of an image format: png, raw, ktx2 or dds. Empty if unknown.
+std::string imageExtension(const std::string &format);
+
+// Writes a texture with all the levels of the chain, which holds 4 channels for RGBA8 and 1
+// otherwise. container is raw (level data only, largest level first), ktx2 or dds. threads are
+// used for block compression. Returns false if the file could not be written.
+bool writeTexture(const std::string &path, const std::string &container, const MipChain &chain, TextureFormat format,
+                  int threads = 0);
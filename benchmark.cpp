@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "Batch.h"
+#include "FontAtlas.h"
+
+// Times every stage of FontAtlas::generate over the jobs of a batch job file and writes the median
+// and 95th percentile of each stage as JSON.
+//
+// fontAtlasBenchmark <job file> [-repetitions <runs per job>] [-threads <render threads>] [-out <results.json>]
+
+// nearest rank percentile of a sorted, non empty list of samples
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    size_t rank = (size_t)std::ceil(p * sorted.size());
+    return sorted[std::clamp(rank, (size_t)1, sorted.size()) - 1];
+}
+
+static nlohmann::json summarise(std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return {
+        {"median_ms", percentile(samples, 0.5)},
+        {"p95_ms", percentile(samples, 0.95)},
+        {"min_ms", samples.front()},
+        {"max_ms", samples.back()},
+    };
+}
+
+static std::string argument(int argc, char **argv, const std::string &name, const std::string &fallback)
+{
+    for (int i = 2; i + 1 < argc; ++i)
+    {
+        if (argv[i] == name)
+        {
+            return argv[i + 1];
+        }
+    }
+    return fallback;
+}
+
+// Makes a scratch directory the working directory for its lifetime, then restores the previous
+// one and removes the scratch directory, however the benchmark exits.
+struct ScratchDirectory {
+    std::filesystem::path path;
+    std::filesystem::path previous;
+
+    explicit ScratchDirectory(std::filesystem::path scratch) : path(scratch), previous(std::filesystem::current_path())
+    {
+        std::filesystem::create_directories(path);
+        std::filesystem::current_path(path);
+    }
+
+    ~ScratchDirectory()
+    {
+        std::error_code error;
+        std::filesystem::current_path(previous, error);
+        std::filesystem::remove_all(path, error);
+    }
+};
+
+// Whether FreeType can load the job's font, checked before it is timed.
+static bool canLoadFont(FT_Library ft, const std::filesystem::path &font)
+{
+    std::shared_ptr<FontFile> fontFile = FontFile::open(font);
+    FT_Face face;
+    if (!fontFile || FT_New_Memory_Face(ft, fontFile->data(), (FT_Long)fontFile->size(), 0, &face))
+    {
+        return false;
+    }
+    FT_Done_Face(face);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: fontAtlasBenchmark <job file> [-repetitions <runs per job>] [-threads <render threads>] [-out <results.json>]"
+                  << std::endl;
+        return 1;
+    }
+
+    int repetitions = std::max(1, std::stoi(argument(argc, argv, "-repetitions", "5")));
+    std::filesystem::path outPath = std::filesystem::absolute(argument(argc, argv, "-out", "benchmark.json"));
+
+    int threads = 0;
+    std::vector<BatchJob> jobs;
+    if (!loadBatchJobs(std::filesystem::absolute(argv[1]), jobs, threads))
+    {
+        return 1;
+    }
+
+    FontAtlasSettings settings;
+    settings.threads = std::stoi(argument(argc, argv, "-threads", "0"));
+
+    FT_Library ft;
+    if (FT_Init_FreeType(&ft))
+    {
+        std::cout << "Could not init FreeType Library" << std::endl;
+        return 1;
+    }
+
+    // atlases are written to a scratch directory so repeated runs do not touch the working tree
+    ScratchDirectory scratch(std::filesystem::temp_directory_path() / "fontAtlasBenchmark");
+
+    nlohmann::json results;
+    results["repetitions"] = repetitions;
+    results["threads"] = settings.threads;
+    results["jobs"] = nlohmann::json::array();
+
+    std::map<std::string, std::vector<double>> allStages;
+    int failures = 0;
+    for (auto &job : jobs)
+    {
+        std::cout << "Benchmarking " << job.font.filename() << " " << job.size << " " << job.type
+                  << (job.retina ? " retina" : "") << "..." << std::endl;
+        if (!canLoadFont(ft, job.font))
+        {
+            std::cout << "    Failed to load font " << job.font << ", skipping" << std::endl;
+            failures++;
+            continue;
+        }
+
+        std::map<std::string, std::vector<double>> stages;
+        bool record = false;
+        settings.onStage = [&](const char *stage, double ms) {
+            if (record)
+            {
+                stages[stage].push_back(ms);
+            }
+        };
+
+        // the pipeline logs every stage, keep that out of the benchmark output
+        std::ofstream silent;
+        std::streambuf *coutBuffer = std::cout.rdbuf(silent.rdbuf());
+        // one discarded warm up run so the font file and allocator are hot for the timed ones
+        for (int run = 0; run <= repetitions; ++run)
+        {
+            record = run > 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            FontAtlas atlas(job.font, job.size, job.maxCodepoint, job.retina, job.type, settings);
+            if (record)
+            {
+                stages["total"].push_back(
+                    std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+            }
+        }
+        std::cout.rdbuf(coutBuffer);
+        std::cout.clear();
+
+        nlohmann::json result;
+        result["font"] = job.font.filename().string();
+        result["size"] = job.size;
+        result["type"] = job.type;
+        result["retina"] = job.retina;
+        result["maxCodepoint"] = job.maxCodepoint;
+        for (auto &stage : stages)
+        {
+            result["stages"][stage.first] = summarise(stage.second);
+            auto &all = allStages[stage.first];
+            all.insert(all.end(), stage.second.begin(), stage.second.end());
+            std::cout << "    " << stage.first << ": median " << result["stages"][stage.first]["median_ms"]
+                      << " ms, p95 " << result["stages"][stage.first]["p95_ms"] << " ms" << std::endl;
+        }
+        results["jobs"].push_back(result);
+    }
+
+    // every sample of every job, for a single number per stage to compare between builds
+    for (auto &stage : allStages)
+    {
+        results["stages"][stage.first] = summarise(stage.second);
+    }
+
+    FT_Done_FreeType(ft);
+
+    std::ofstream out(outPath);
+    if (!out)
+    {
+        std::cout << "Unable to open " << outPath << " for writing" << std::endl;
+        return 1;
+    }
+    out << results.dump(4) << std::endl;
+    std::cout << "Written " << outPath << std::endl;
+    return failures ? 1 : 0;
+}
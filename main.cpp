@@ -1,7 +1,10 @@
 #include <filesystem>
 #include <string>
 #include <iostream>
+#include <sstream>
 
+#include "Batch.h"
+#include "ChannelPacker.h"
 #include "FontAtlas.h"
 
 // parameter name -> (expected parameters, default value)
@@ -12,6 +15,31 @@ const std::map<std::string, std::pair<int, std::string>> params = {
     {"-maxCodepoint", {1, "128"}},
     {"-retina", {0, "0"}},
     {"-type", {1, "sdf"}},
+    {"-threads", {1, "0"}},
+    {"-optimiseWidth", {0, "0"}},
+    {"-packer", {1, "shelf"}},
+    {"-packOrder", {1, "none"}},
+    {"-direct", {0, "0"}},
+    {"-batch", {1, ""}},
+    {"-cache", {1, ""}},
+    {"-glyphCache", {1, ""}},
+    {"-manifest", {1, "json"}},
+    {"-maxTextureSize", {1, "0"}},
+    {"-channelPack", {0, "0"}},
+    {"-dedupeBitmaps", {0, "0"}},
+    {"-stats", {0, "0"}},
+    {"-imageFormat", {1, "png"}},
+    {"-mipLevels", {1, "1"}},
+    {"-padding", {1, "-1"}},
+    {"-sdfEngine", {1, "freetype"}},
+    {"-spread", {1, "0"}},
+    {"-oversample", {1, "4"}},
+    {"-compression", {1, "none"}},
+    {"-pngEncoder", {1, "stb"}},
+    {"-pngLevel", {1, "-1"}},
+    {"-pngFilter", {1, "adaptive"}},
+    {"-combine", {1, ""}},
+    {"-out", {1, "combined"}},
 };
 
 std::string getParameter(int argc, char **argv, std::string search) {
@@ -47,6 +75,46 @@ std::string getParameter(int argc, char **argv, std::string search) {
 int main(int argc, char **argv)
 {
     if(argc > 1) {
+        FontAtlasSettings settings;
+        settings.threads = std::stoi(getParameter(argc, argv, "-threads"));
+        settings.optimiseWidth = std::stoi(getParameter(argc, argv, "-optimiseWidth"));
+        settings.packer = getParameter(argc, argv, "-packer");
+        settings.packOrder = getParameter(argc, argv, "-packOrder");
+        settings.directRasterize = std::stoi(getParameter(argc, argv, "-direct"));
+        settings.cacheDir = getParameter(argc, argv, "-cache");
+        settings.glyphCacheDir = getParameter(argc, argv, "-glyphCache");
+        settings.manifestFormat = getParameter(argc, argv, "-manifest");
+        settings.maxTextureSize = std::stoi(getParameter(argc, argv, "-maxTextureSize"));
+        settings.channelPack = std::stoi(getParameter(argc, argv, "-channelPack"));
+        settings.dedupeBitmaps = std::stoi(getParameter(argc, argv, "-dedupeBitmaps"));
+        settings.writeStats = std::stoi(getParameter(argc, argv, "-stats"));
+        settings.imageFormat = getParameter(argc, argv, "-imageFormat");
+        settings.mipLevels = std::stoi(getParameter(argc, argv, "-mipLevels"));
+        settings.padding = std::stoi(getParameter(argc, argv, "-padding"));
+        settings.sdfEngine = getParameter(argc, argv, "-sdfEngine");
+        settings.spread = std::stoi(getParameter(argc, argv, "-spread"));
+        settings.oversample = std::stoi(getParameter(argc, argv, "-oversample"));
+        settings.textureCompression = getParameter(argc, argv, "-compression");
+        settings.png.encoder = getParameter(argc, argv, "-pngEncoder");
+        settings.png.level = std::stoi(getParameter(argc, argv, "-pngLevel"));
+        settings.png.filter = getParameter(argc, argv, "-pngFilter");
+        settings.png.threads = settings.threads;
+
+        std::string combine = getParameter(argc, argv, "-combine");
+        if(!combine.empty()) {
+            std::vector<std::string> manifests;
+            std::stringstream list(combine);
+            for(std::string manifest; std::getline(list, manifest, ',');) {
+                manifests.push_back(manifest);
+            }
+            return combineAtlases(manifests, getParameter(argc, argv, "-out"), settings.png);
+        }
+
+        std::string batch = getParameter(argc, argv, "-batch");
+        if(!batch.empty()) {
+            return runBatch(batch, settings);
+        }
+
         std::filesystem::path path(getParameter(argc, argv, "-in"));
         if(std::filesystem::exists(path)) {
             FontAtlas* fontAtlas = new FontAtlas(
@@ -54,8 +122,10 @@ int main(int argc, char **argv)
                 std::stoi(getParameter(argc, argv, "-size")),
                 std::stoi(getParameter(argc, argv, "-maxCodepoint")),
                 std::stoi(getParameter(argc, argv, "-retina")),
-                getParameter(argc, argv, "-type")
+                getParameter(argc, argv, "-type"),
+                settings
             );
+            return fontAtlas->succeeded ? 0 : 1;
         } else {
             std::cout << path << " does not exist." << std::endl;
         }
@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <png.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include "../PngEncoder.h"
+
+// Writes the same images with every encoder and filter, decodes them with libpng, which rejects
+// bad chunk CRCs, and checks that the pixels read back are the ones written.
+
+// Reads every chunk up to and including IEND, which the simplified libpng API never looks at.
+static bool decode(const std::string &path, int channels, std::vector<unsigned char> &pixels, int &width, int &height)
+{
+    static const int colorTypes[] = {PNG_COLOR_TYPE_GRAY, PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_RGB_ALPHA};
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png ? png_create_info_struct(png) : nullptr;
+    if (!info || setjmp(png_jmpbuf(png)))
+    {
+        png_destroy_read_struct(&png, &info, nullptr);
+        fclose(file);
+        return false;
+    }
+
+    png_init_io(png, file);
+    png_read_info(png, info);
+    width = png_get_image_width(png, info);
+    height = png_get_image_height(png, info);
+    bool matches = png_get_bit_depth(png, info) == 8 && png_get_color_type(png, info) == colorTypes[channels - 1];
+    if (matches)
+    {
+        pixels.resize((size_t)width * height * channels);
+        for (int y = 0; y < height; ++y)
+        {
+            png_read_row(png, pixels.data() + (size_t)y * width * channels, nullptr);
+        }
+        png_read_end(png, nullptr);
+    }
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(file);
+    return matches;
+}
+
+int main()
+{
+    std::filesystem::path scratch = std::filesystem::temp_directory_path() / "fontAtlasPngEncoderTest";
+    std::filesystem::create_directories(scratch);
+
+    int failures = 0;
+    // large enough for the parallel encoder to split the image into several bands
+    const int width = 1021;
+    const int height = 1024;
+    for (int channels = 1; channels <= 4; ++channels)
+    {
+        // glyph like shapes with noise, so every filter gets used by the adaptive choice
+        std::vector<unsigned char> pixels((size_t)width * height * channels);
+        srand(channels);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width * channels; ++x)
+            {
+                bool shape = ((x / 37) + (y / 29)) % 3 == 0;
+                pixels[(size_t)y * width * channels + x] = shape ? rand() % 256 : (x + y) % 7 == 0 ? 255 : 0;
+            }
+        }
+
+        std::vector<PngOptions> encoders;
+        encoders.push_back({"stb"});
+        for (const char *filter : {"none", "sub", "up", "average", "paeth", "adaptive"})
+        {
+            encoders.push_back({"libpng", -1, filter});
+            encoders.push_back({"parallel", -1, filter, 4});
+        }
+        encoders.push_back({"parallel", 1, "adaptive", 1});
+        encoders.push_back({"parallel", 9, "adaptive", 3});
+
+        for (size_t e = 0; e < encoders.size(); ++e)
+        {
+            const PngOptions &options = encoders[e];
+            std::string name = options.encoder + " " + options.filter + " level " + std::to_string(options.level) +
+                               " threads " + std::to_string(options.threads) + ", " + std::to_string(channels) +
+                               " channel(s)";
+            std::string path = (scratch / ("image" + std::to_string(e) + ".png")).string();
+
+            std::vector<unsigned char> decoded;
+            int decodedWidth = 0;
+            int decodedHeight = 0;
+            if (!writePng(path, pixels.data(), width, height, channels, options) ||
+                !decode(path, channels, decoded, decodedWidth, decodedHeight))
+            {
+                std::cout << "FAIL " << name << ": could not be written or read back" << std::endl;
+                failures++;
+                continue;
+            }
+            if (decodedWidth != width || decodedHeight != height || decoded != pixels)
+            {
+                std::cout << "FAIL " << name << ": decoded pixels differ" << std::endl;
+                failures++;
+                continue;
+            }
+            std::cout << "ok   " << name << std::endl;
+        }
+    }
+
+    std::filesystem::remove_all(scratch);
+    return failures ? 1 : 0;
+}